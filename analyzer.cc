@@ -3,59 +3,534 @@
 
 #include "ast.cc"
 #include "builtins.cc"
+#include "call_graph.cc"
+#include "constant_folding.cc"
+#include "scoped_symbol_map.cc"
+#include "thread_pool.cc"
 
-struct Analyzer {
-  Program* program;
+// Index of builtin functions in place of their index in Program::functions.
+const uint32_t BUILTIN_FUNCTION = UINT32_MAX;
 
-  Result<None> analyzeProgram(Program& node) {
-    this->program = &node;
+// Parameter and return types of a function that can be called.
+struct FunctionSignature {
+  // Range of the parameter types in the FunctionTable's parameterTypes.
+  uint32_t parameterStart;
+  uint32_t parameterCount;
+  Type returnType;
+  Location location;
+  // Index of the function in Program::functions, or BUILTIN_FUNCTION.
+  uint32_t functionIndex = BUILTIN_FUNCTION;
+};
 
-    for (size_t i = 0; i < node.functions.size(); i++) {
-      TRY(this->analyzeFunctionDeclaration(node.functions[i]));
+// Every function of the program, along with the builtins. It's filled before
+// any function body is analyzed, and only read from then on.
+struct FunctionTable {
+  ScopedSymbolMap<FunctionSignature> functions;
+  Vector<Type> parameterTypes;
+};
+
+// Include added while analyzing a function. Includes are merged in the order
+// of their functionIndex and then their order within the function, which is
+// the order a serial analysis would add them in.
+struct IncludeUse {
+  String include;
+  uint32_t functionIndex;
+  uint32_t order;
+};
+
+// Error of a function that failed to analyze.
+struct FunctionError {
+  uint32_t functionIndex;
+  ErrorId error;
+};
+
+// Warning found while analyzing the function at the given index.
+struct FunctionWarning {
+  uint32_t functionIndex;
+  ErrorId warning;
+};
+
+// Parameter or variable visible in the function being analyzed.
+struct Variable {
+  Type type;
+  // Index of the variable's Ownership in the FunctionAnalyzer.
+  uint32_t ownership;
+};
+
+// How the value of a parameter or variable is used, which tells the forks
+// that can be moves and the parameters that could be borrows apart.
+struct Ownership {
+  // fork() of the value, if that's its latest use so far.
+  FunctionCall* lastFork = nullptr;
+  // Whether the value was handed to something that keeps it, which is a
+  // function of the program, a variable or the return value.
+  bool isPassedOn = false;
+};
+
+// Analyzes function bodies. Every thread analyzing functions has its own, so
+// nothing it changes is shared. It's aligned to a cache line so neighbouring
+// analyzers in a Vector don't share one.
+struct alignas(64) FunctionAnalyzer {
+  // Nodes are only changed to fill in inferred types, and every function's
+  // nodes are its own, so analyzers never write to the same node.
+  Ast* ast;
+  const FunctionTable* functionTable;
+  // Parameters and variables visible in the current scope.
+  ScopedSymbolMap<Variable> variables;
+  // Ownership of every parameter and then every variable of the function
+  // being analyzed, in the order they are declared.
+  Vector<Ownership> ownerships;
+  // Declared return type of the function being analyzed.
+  Type returnType;
+  // Index of the function being analyzed, and the includes it added so far.
+  uint32_t functionIndex = 0;
+  uint32_t includeCount = 0;
+  // First use of each include in the functions analyzed here.
+  Vector<IncludeUse> includes;
+  // Calls the functions analyzed here make to other functions of the program.
+  Vector<Call> calls;
+  // Error of the function with the lowest index that failed here.
+  Optional<FunctionError> firstError;
+  Vector<FunctionWarning> warnings;
+
+  void analyzeFunction(FunctionDeclaration& node, uint32_t functionIndex) {
+    this->functionIndex = functionIndex;
+    this->includeCount = 0;
+    this->ownerships.clear();
+    Result<None> result = this->analyzeFunctionDeclaration(node);
+    if (result.ok) {
+      return;
+    }
+    // The scopes that were open when the error happened were never popped.
+    this->variables = ScopedSymbolMap<Variable>();
+    if (!this->firstError.has_value() ||
+        functionIndex < this->firstError->functionIndex) {
+      this->firstError = FunctionError{.functionIndex = functionIndex,
+                                       .error = result.error};
     }
-    return Ok();
   }
 
   Result<None> analyzeFunctionDeclaration(FunctionDeclaration& node) {
+    this->returnType = node.returnType;
     // Validate main function.
-    if (node.name == "main") {
+    if (node.name == Symbol::MAIN) {
       if (!node.returnType.equals(BaseType::VOID) &&
           !node.returnType.equals(BaseType::INT)) {
-        return Error("main function can only return VOID or INT.");
+        Location loc = node.returnTypeLocation;
+        return Error("main function can only return VOID or INT at {}.", loc);
       }
       node.returnType = Type(BaseType::INT);
     }
+
+    // Parameters are in a scope of their own, so the body's variables can
+    // shadow them.
+    this->variables.pushScope();
+    for (const auto& param : this->ast->get(node.params)) {
+      if (this->variables.isInCurrentScope(param.name)) {
+        Location loc = param.location;
+        return Error("Parameter {} is already declared at {}.",
+                     symbolTable.getName(param.name), loc);
+      }
+      this->declareVariable(param.name, param.type);
+    }
     TRY(this->analyzeStatementBlock(node.body));
+    this->variables.popScope();
+    // Without branches, a function returns a value on every path exactly when
+    // its last statement does. main returns 0 where it returns nothing.
+    if (node.name != Symbol::MAIN && !node.returnType.equals(BaseType::VOID) &&
+        !this->ast->get(node.body.statements).back().is<Return>()) {
+      Location loc = node.location;
+      return Error("Function {} at {} can end without returning a value.",
+                   symbolTable.getName(node.name), loc);
+    }
+    this->checkOwnership(node);
     return Ok();
   }
 
+  void declareVariable(Symbol name, const Type& type) {
+    this->variables.set(
+        name, Variable{.type = type,
+                       .ownership = (uint32_t)this->ownerships.size()});
+    this->ownerships.push_back(Ownership());
+  }
+
+  // Turns forks that are the last use of their value into moves, which saves
+  // adding and later dropping a reference. Functions have no branches yet, so
+  // the last use in the order uses are analyzed is the last use at runtime.
+  void checkOwnership(const FunctionDeclaration& node) {
+    Span<const FunctionParameter> params = this->ast->get(node.params);
+    for (size_t i = 0; i < this->ownerships.size(); i++) {
+      const Ownership& ownership = this->ownerships[i];
+      if (i < params.size() && params[i].type.equals(BaseType::STRING) &&
+          !ownership.isPassedOn) {
+        Location loc = params[i].location;
+        this->addWarning(
+            "Parameter {} of {} is only read, so it could be borrowed at {}.",
+            symbolTable.getName(params[i].name), symbolTable.getName(node.name),
+            loc);
+      }
+      if (ownership.lastFork != nullptr) {
+        FunctionCall& fork = *ownership.lastFork;
+        fork.isMove = true;
+        Symbol name =
+            this->ast->get<VariableReference>(this->ast->get(fork.args)[0])
+                .name;
+        Location loc = fork.location;
+        this->addWarning(
+            "Unnecessary fork of {} at {}, since it isn't used afterwards.",
+            symbolTable.getName(name), loc);
+      }
+    }
+  }
+
+  template <typename... Args>
+  void addWarning(std::format_string<Args...> fmt, Args&&... args) {
+    this->warnings.push_back(FunctionWarning{
+        .functionIndex = this->functionIndex,
+        .warning = getDiagnostics().add(fmt, std::forward<Args>(args)...)});
+  }
+
+  // Marks the variable as passed on if the expression hands over its value,
+  // either directly or through a fork.
+  void passOn(const Expression& node) {
+    Expression value = node;
+    if (node.is<FunctionCall>()) {
+      const FunctionCall& call = this->ast->get<FunctionCall>(node);
+      if (call.name != Symbol::FORK) {
+        return;
+      }
+      value = this->ast->get(call.args)[0];
+    }
+    if (value.is<VariableReference>()) {
+      Symbol name = this->ast->get<VariableReference>(value).name;
+      this->ownerships[this->variables.get(name)->ownership].isPassedOn = true;
+    }
+  }
+
   Result<None> analyzeStatementBlock(const StatementBlock& node) {
     if (node.statements.size() == 0) {
-      return Error("Cannot have an empty statement block.");
+      Location loc = node.location;
+      return Error("Cannot have an empty statement block at {}.", loc);
     }
-    for (size_t i = 0; i < node.statements.size(); i++) {
-      TRY(this->analyzeStatement(node.statements[i]));
+    this->variables.pushScope();
+    for (const auto& statement : this->ast->get(node.statements)) {
+      TRY(this->analyzeStatement(statement));
     }
+    this->variables.popScope();
     return Ok();
   }
 
   Result<None> analyzeStatement(const Statement& node) {
-    if (std::holds_alternative<Unique<FunctionCall>>(node)) {
-      TRY(this->analyzeFunctionCall(*std::get<Unique<FunctionCall>>(node)));
+    return visit(*this->ast, node,
+                 Overloaded{[&](VariableDeclaration& node) {
+                              return this->analyzeVariableDeclaration(node);
+                            },
+                            [&](FunctionCall& node) -> Result<None> {
+                              // The returned value is discarded.
+                              TRY([[maybe_unused]] Type type,
+                                  this->analyzeFunctionCall(node));
+                              return Ok();
+                            },
+                            [&](const Return& node) {
+                              return this->analyzeReturn(node);
+                            }});
+  }
+
+  // Resolves the names in the expression and returns its type.
+  Result<Type> analyzeExpression(const Expression& node) {
+    return visit(*this->ast, node,
+                 Overloaded{[&](const VariableReference& node) {
+                              return this->analyzeVariableReference(node);
+                            },
+                            [&](FunctionCall& node) {
+                              return this->analyzeFunctionCall(node);
+                            },
+                            [&](const NumberLiteral& node) {
+                              return this->analyzeNumberLiteral(node);
+                            },
+                            [&](const StringLiteral&) {
+                              return Ok(Type(BaseType::STRING));
+                            },
+                            [&](const BinaryExpression& node) {
+                              return this->analyzeBinaryExpression(node);
+                            }});
+  }
+
+  Result<None> analyzeVariableDeclaration(VariableDeclaration& node) {
+    if (this->variables.isInCurrentScope(node.name)) {
+      Location loc = node.location;
+      return Error("Variable {} is already declared at {}.",
+                   symbolTable.getName(node.name), loc);
+    }
+    TRY(Type type, this->analyzeExpression(node.expression));
+    if (type.equals(BaseType::VOID)) {
+      Location loc = node.location;
+      return Error("Variable {} can't be given a VOID value at {}.",
+                   symbolTable.getName(node.name), loc);
+    }
+    if (!node.hasDeclaredType) {
+      node.type = type;
+    } else if (type != node.type) {
+      Location loc = node.location;
+      return Error("Variable {} is {} but was given {} at {}.",
+                   symbolTable.getName(node.name), node.type.toString(),
+                   type.toString(), loc);
     }
+    this->passOn(node.expression);
+    this->declareVariable(node.name, node.type);
     return Ok();
   }
 
-  Result<None> analyzeFunctionCall(const FunctionCall& node) {
-    if (node.name == "println") {
+  Result<Type> analyzeVariableReference(const VariableReference& node) {
+    Variable* variable = this->variables.get(node.name);
+    if (variable == nullptr) {
+      Location loc = node.location;
+      return Error("Undefined variable {} at {}.",
+                   symbolTable.getName(node.name), loc);
+    }
+    // A later use means an earlier fork is still needed.
+    this->ownerships[variable->ownership].lastFork = nullptr;
+    return Ok(variable->type);
+  }
+
+  // Checks a fork(), which adds a reference to the value of a variable.
+  Result<Type> analyzeFork(FunctionCall& node) {
+    Span<const Expression> args = this->ast->get(node.args);
+    if (args.size() != 1 || !args[0].is<VariableReference>()) {
+      Location loc = node.location;
+      return Error("fork takes a single variable at {}.", loc);
+    }
+    const VariableReference& reference =
+        this->ast->get<VariableReference>(args[0]);
+    TRY(Type type, this->analyzeVariableReference(reference));
+    Variable* variable = this->variables.get(reference.name);
+    this->ownerships[variable->ownership].lastFork = &node;
+    return Ok(type);
+  }
+
+  Result<Type> analyzeFunctionCall(FunctionCall& node) {
+    if (node.name == Symbol::FORK) {
+      return this->analyzeFork(node);
+    }
+    const FunctionSignature* signature =
+        this->functionTable->functions.get(node.name);
+    if (signature == nullptr) {
+      Location loc = node.location;
+      return Error("Undefined function {} at {}.",
+                   symbolTable.getName(node.name), loc);
+    }
+    if (node.args.size() != signature->parameterCount) {
+      Location loc = node.location;
+      return Error("Function {} takes {} arguments but got {} at {}.",
+                   symbolTable.getName(node.name), signature->parameterCount,
+                   node.args.size(), loc);
+    }
+
+    Span<const Expression> args = this->ast->get(node.args);
+    for (size_t i = 0; i < args.size(); i++) {
+      TRY(Type type, this->analyzeExpression(args[i]));
+      const Type& parameterType =
+          this->functionTable->parameterTypes[signature->parameterStart + i];
+      if (type != parameterType) {
+        Location loc = this->getLocation(args[i]);
+        return Error("Argument {} of {} must be {} but got {} at {}.",
+                     i + 1, symbolTable.getName(node.name),
+                     parameterType.toString(), type.toString(), loc);
+      }
+    }
+
+    if (node.name == Symbol::PRINTLN) {
       this->addInclude("stdio.h");
     }
+    if (signature->functionIndex != BUILTIN_FUNCTION) {
+      this->calls.push_back(Call{.caller = this->functionIndex,
+                                 .callee = signature->functionIndex});
+      // Builtins only read their arguments, but functions of the program take
+      // ownership of them.
+      for (const auto& arg : args) {
+        this->passOn(arg);
+      }
+    }
+    return Ok(signature->returnType);
+  }
+
+  Result<Type> analyzeNumberLiteral(const NumberLiteral& node) {
+    Constant constant = parseNumber(node.value);
+    if (!constant.isKnown()) {
+      Location loc = node.location;
+      return Error("Number {} at {} doesn't fit in its type.", node.value, loc);
+    }
+    return Ok(Type(constant.type));
+  }
+
+  Result<Type> analyzeBinaryExpression(const BinaryExpression& node) {
+    TRY(Type left, this->analyzeExpression(node.left));
+    TRY(Type right, this->analyzeExpression(node.right));
+    bool isNumber = left.equals(BaseType::INT) || left.equals(BaseType::FLOAT);
+    if (left != right || !isNumber) {
+      Location loc = node.location;
+      return Error("Operator {} can't be applied to {} and {} at {}.",
+                   binaryOperatorToString(node.op), left.toString(),
+                   right.toString(), loc);
+    }
+    // Comparisons result in an INT, like in C.
+    if (node.op == BinaryOperator::ADD || node.op == BinaryOperator::SUBTRACT) {
+      return Ok(left);
+    }
+    return Ok(Type(BaseType::INT));
+  }
+
+  Result<None> analyzeReturn(const Return& node) {
+    Type type = Type(BaseType::VOID);
+    if (node.expression.has_value()) {
+      TRY(type, this->analyzeExpression(node.expression.value()));
+      this->passOn(node.expression.value());
+    }
+    if (type != this->returnType) {
+      Location loc = node.location;
+      return Error("Function returns {} but got {} at {}.",
+                   this->returnType.toString(), type.toString(), loc);
+    }
     return Ok();
   }
 
+  Location getLocation(const Expression& node) {
+    return visit(*this->ast, node,
+                 [](const auto& node) { return node.location; });
+  }
+
   void addInclude(String include) {
-    this->program->includes.push_back(std::move(include));
+    uint32_t order = this->includeCount++;
+    for (auto& use : this->includes) {
+      if (use.include == include) {
+        if (this->functionIndex < use.functionIndex) {
+          use.functionIndex = this->functionIndex;
+          use.order = order;
+        }
+        return;
+      }
+    }
+    this->includes.push_back(IncludeUse{.include = std::move(include),
+                                        .functionIndex = this->functionIndex,
+                                        .order = order});
+  }
+};
+
+struct Analyzer {
+  Program* program;
+  FunctionTable functionTable;
+  // Pool to analyze function bodies on, or null to analyze them on the
+  // calling thread.
+  ThreadPool* threadPool = nullptr;
+
+  Result<None> analyzeProgram(Program& node) {
+    this->program = &node;
+
+    // Declare every function before analyzing any, so functions can be
+    // called before they are declared.
+    this->addBuiltinFunction(Symbol::PRINTLN, BaseType::VOID,
+                             {BaseType::STRING});
+    // fork() takes a variable of any type, so it's checked separately and only
+    // declared to keep functions of the program from using its name.
+    this->addBuiltinFunction(Symbol::FORK, BaseType::VOID, {});
+    for (size_t i = 0; i < node.functions.size(); i++) {
+      TRY(this->declareFunction(node.functions[i], i));
+    }
+
+    size_t workerCount =
+        this->threadPool != nullptr ? this->threadPool->getWorkerCount() : 1;
+    Vector<FunctionAnalyzer> analyzers(
+        workerCount, FunctionAnalyzer{.ast = &node.ast,
+                                      .functionTable = &this->functionTable});
+    auto analyzeFunction = [&](size_t index, size_t worker) {
+      analyzers[worker].analyzeFunction(node.functions[index], index);
+    };
+    if (this->threadPool != nullptr) {
+      this->threadPool->parallelFor(node.functions.size(), analyzeFunction);
+    } else {
+      for (size_t i = 0; i < node.functions.size(); i++) {
+        analyzeFunction(i, 0);
+      }
+    }
+    return this->mergeResults(analyzers);
+  }
+
+  // Combines what each analyzer found in function order, so the result is the
+  // same however the functions were split between threads.
+  Result<None> mergeResults(Vector<FunctionAnalyzer>& analyzers) {
+    Optional<FunctionError> firstError;
+    Vector<IncludeUse> includes;
+    Vector<Call> calls;
+    Vector<FunctionWarning> warnings;
+    for (auto& analyzer : analyzers) {
+      if (analyzer.firstError.has_value() &&
+          (!firstError.has_value() ||
+           analyzer.firstError->functionIndex < firstError->functionIndex)) {
+        firstError = analyzer.firstError;
+      }
+      for (auto& use : analyzer.includes) {
+        includes.push_back(std::move(use));
+      }
+      calls.insert(calls.end(), analyzer.calls.begin(), analyzer.calls.end());
+      warnings.insert(warnings.end(), analyzer.warnings.begin(),
+                      analyzer.warnings.end());
+    }
+    if (firstError.has_value()) {
+      return Error(firstError->error);
+    }
+
+    std::sort(includes.begin(), includes.end(),
+              [](const IncludeUse& a, const IncludeUse& b) {
+                return std::tie(a.functionIndex, a.order) <
+                       std::tie(b.functionIndex, b.order);
+              });
+    for (auto& use : includes) {
+      this->program->includes.add(std::move(use.include));
+    }
+    this->program->callGraph =
+        CallGraph::build(this->program->functions.size(), std::move(calls));
+    // Warnings of the same function are already in order.
+    std::stable_sort(warnings.begin(), warnings.end(),
+                     [](const FunctionWarning& a, const FunctionWarning& b) {
+                       return a.functionIndex < b.functionIndex;
+                     });
+    for (const auto& warning : warnings) {
+      this->program->warnings.push_back(warning.warning);
+    }
+    return Ok();
+  }
+
+  void addBuiltinFunction(Symbol name, BaseType returnType,
+                          std::initializer_list<BaseType> parameters) {
+    FunctionSignature signature = {
+        .parameterStart = (uint32_t)this->functionTable.parameterTypes.size(),
+        .parameterCount = (uint32_t)parameters.size(),
+        .returnType = returnType};
+    for (BaseType parameter : parameters) {
+      this->functionTable.parameterTypes.push_back(Type(parameter));
+    }
+    this->functionTable.functions.set(name, signature);
+  }
+
+  Result<None> declareFunction(const FunctionDeclaration& node,
+                               uint32_t functionIndex) {
+    if (this->functionTable.functions.get(node.name) != nullptr) {
+      Location loc = node.location;
+      return Error("Function {} is already declared at {}.",
+                   symbolTable.getName(node.name), loc);
+    }
+    FunctionSignature signature = {
+        .parameterStart = (uint32_t)this->functionTable.parameterTypes.size(),
+        .parameterCount = (uint32_t)node.params.size(),
+        .returnType = node.returnType,
+        .location = node.location,
+        .functionIndex = functionIndex};
+    for (const auto& param : this->program->ast.get(node.params)) {
+      this->functionTable.parameterTypes.push_back(param.type);
+    }
+    this->functionTable.functions.set(node.name, signature);
+    return Ok();
   }
 };
 
-#endif  // ANALYZER_CC
\ No newline at end of file
+#endif  // ANALYZER_CC
@@ -1,13 +1,20 @@
 #ifndef AST_CC
 #define AST_CC
 
+#include <tuple>
+#include <type_traits>
+
 #include "builtins.cc"
+#include "call_graph.cc"
+#include "location.cc"
+#include "symbol_table.cc"
 
 // Base Type enum and their string names for debugging.
 #define FOREACH_BASE_TYPE(GENERATOR) \
   GENERATOR(VOID)                    \
   GENERATOR(INT)                     \
-  GENERATOR(FLOAT)
+  GENERATOR(FLOAT)                   \
+  GENERATOR(STRING)
 enum class BaseType { FOREACH_BASE_TYPE(ENUM_GENERATOR) };
 static const char* baseTypeString[] = {FOREACH_BASE_TYPE(STRING_GENERATOR)};
 String baseTypeToString(BaseType type) {
@@ -16,6 +23,8 @@ String baseTypeToString(BaseType type) {
 
 struct ListType {
   BaseType elementType;
+
+  bool operator==(const ListType& other) const = default;
 };
 
 struct Type {
@@ -33,103 +42,420 @@ struct Type {
 
   ListType getListType() const { return std::get<ListType>(this->typeVariant); }
 
-  bool equals(BaseType baseType) {
+  bool equals(BaseType baseType) const {
     return this->isBaseType() && this->getBaseType() == baseType;
   }
 
-  bool equals(ListType listType) {
+  bool equals(ListType listType) const {
     return this->isListType() &&
            this->getListType().elementType == listType.elementType;
   }
+
+  bool operator==(const Type& other) const = default;
+
+  String toString() const {
+    if (this->isListType()) {
+      return "[" + baseTypeToString(this->getListType().elementType) + "]";
+    }
+    return baseTypeToString(this->getBaseType());
+  }
 };
 
-// Forward declare Ast Nodes that are used in Statement or Expression variants.
+// Forward declare Ast Nodes that are referenced by Statement or Expression
+// handles.
 struct VariableDeclaration;
 struct VariableReference;
 struct FunctionCall;
 struct NumberLiteral;
 struct StringLiteral;
+struct BinaryExpression;
 struct Return;
 
-using Statement =
-    Variant<Unique<VariableDeclaration>, Unique<FunctionCall>, Unique<Return>>;
+// Node Kind enum of every node that lives in an Ast pool, along with its type.
+#define FOREACH_NODE_KIND(GENERATOR)                   \
+  GENERATOR(VARIABLE_DECLARATION, VariableDeclaration) \
+  GENERATOR(VARIABLE_REFERENCE, VariableReference)     \
+  GENERATOR(FUNCTION_CALL, FunctionCall)               \
+  GENERATOR(NUMBER_LITERAL, NumberLiteral)             \
+  GENERATOR(STRING_LITERAL, StringLiteral)             \
+  GENERATOR(BINARY_EXPRESSION, BinaryExpression)       \
+  GENERATOR(RETURN, Return)
+#define NODE_KIND_ENUM_GENERATOR(KIND, TYPE) KIND,
+enum class NodeKind : uint8_t { FOREACH_NODE_KIND(NODE_KIND_ENUM_GENERATOR) };
+
+// Node kind of each node type. Types that aren't nodes have no kind.
+template <typename T>
+struct NodeKindOf;
+#define NODE_KIND_OF_GENERATOR(KIND, TYPE)            \
+  template <>                                         \
+  struct NodeKindOf<TYPE> {                           \
+    static constexpr NodeKind kind = NodeKind::KIND; \
+  };
+FOREACH_NODE_KIND(NODE_KIND_OF_GENERATOR)
+template <typename T>
+constexpr NodeKind nodeKindOf = NodeKindOf<T>::kind;
+
+// Handle to a node in the Ast pool of its kind. The tag keeps statement and
+// expression handles from being mixed up.
+template <typename Tag>
+struct NodeHandle {
+  NodeKind kind;
+  uint32_t index;
+
+  // Whether the handle refers to a node of the given type.
+  template <typename T>
+  bool is() const {
+    return this->kind == nodeKindOf<T>;
+  }
+};
+
+struct StatementTag;
+struct ExpressionTag;
+using Statement = NodeHandle<StatementTag>;
+using Expression = NodeHandle<ExpressionTag>;
+
+// Node kinds that statement and expression handles can refer to.
+#define FOREACH_STATEMENT_KIND(GENERATOR)              \
+  GENERATOR(VARIABLE_DECLARATION, VariableDeclaration) \
+  GENERATOR(FUNCTION_CALL, FunctionCall)               \
+  GENERATOR(RETURN, Return)
+#define FOREACH_EXPRESSION_KIND(GENERATOR)           \
+  GENERATOR(VARIABLE_REFERENCE, VariableReference)   \
+  GENERATOR(FUNCTION_CALL, FunctionCall)             \
+  GENERATOR(NUMBER_LITERAL, NumberLiteral)           \
+  GENERATOR(STRING_LITERAL, StringLiteral)           \
+  GENERATOR(BINARY_EXPRESSION, BinaryExpression)
+
+// Whether a handle of the given type can refer to a node of the given type.
+template <typename Handle, typename T>
+constexpr bool canRefer = false;
+#define STATEMENT_CAN_REFER_GENERATOR(KIND, TYPE) \
+  template <>                                     \
+  constexpr bool canRefer<Statement, TYPE> = true;
+FOREACH_STATEMENT_KIND(STATEMENT_CAN_REFER_GENERATOR)
+#define EXPRESSION_CAN_REFER_GENERATOR(KIND, TYPE) \
+  template <>                                      \
+  constexpr bool canRefer<Expression, TYPE> = true;
+FOREACH_EXPRESSION_KIND(EXPRESSION_CAN_REFER_GENERATOR)
+
+// Contiguous run of elements within one of the shared Ast arrays, used for
+// child lists.
+template <typename T>
+struct Range {
+  uint32_t start = 0;
+  uint32_t count = 0;
+
+  size_t size() const { return this->count; }
+};
+
+// Binary operators along with the token they are parsed from, their source
+// text and precedence. Operators with a higher precedence bind tighter, and
+// all of them are left associative. The precedences match C's, so compiled
+// expressions only need parentheses where the source had them.
+#define FOREACH_BINARY_OPERATOR(GENERATOR)         \
+  GENERATOR(EQUAL, EQUAL_EQUAL, "==", 1)           \
+  GENERATOR(NOT_EQUAL, BANG_EQUAL, "!=", 1)        \
+  GENERATOR(LESS, LESS, "<", 2)                    \
+  GENERATOR(LESS_EQUAL, LESS_EQUAL, "<=", 2)       \
+  GENERATOR(GREATER, GREATER, ">", 2)              \
+  GENERATOR(GREATER_EQUAL, GREATER_EQUAL, ">=", 2) \
+  GENERATOR(ADD, PLUS, "+", 3)                     \
+  GENERATOR(SUBTRACT, MINUS, "-", 3)
+#define BINARY_OPERATOR_ENUM_GENERATOR(OPERATOR, TOKEN, TEXT, PRECEDENCE) \
+  OPERATOR,
+enum class BinaryOperator : uint8_t {
+  FOREACH_BINARY_OPERATOR(BINARY_OPERATOR_ENUM_GENERATOR)
+};
+#define BINARY_OPERATOR_TEXT_GENERATOR(OPERATOR, TOKEN, TEXT, PRECEDENCE) TEXT,
+static constexpr const char* binaryOperatorText[] = {
+    FOREACH_BINARY_OPERATOR(BINARY_OPERATOR_TEXT_GENERATOR)};
+#define BINARY_OPERATOR_PRECEDENCE_GENERATOR(OPERATOR, TOKEN, TEXT, \
+                                             PRECEDENCE)            \
+  PRECEDENCE,
+static constexpr int binaryOperatorPrecedence[] = {
+    FOREACH_BINARY_OPERATOR(BINARY_OPERATOR_PRECEDENCE_GENERATOR)};
+
+StringView binaryOperatorToString(BinaryOperator op) {
+  return binaryOperatorText[static_cast<int>(op)];
+}
 
-using Expression = Variant<Unique<VariableReference>, Unique<FunctionCall>,
-                           Unique<StringLiteral>, Unique<NumberLiteral>>;
+constexpr int getPrecedence(BinaryOperator op) {
+  return binaryOperatorPrecedence[static_cast<int>(op)];
+}
 
 struct FunctionParameter {
-  StringView name;
+  Symbol name;
   Type type;
+  Location location;
 };
 
 struct VariableDeclaration {
-  StringView name;
+  Symbol name;
+  // Declared type, or the type of the expression filled in by the Analyzer
+  // when the declaration left it out, as in x := 5.
   Type type;
   Expression expression;
+  Location location;
+  bool hasDeclaredType = true;
+  // Set by escape analysis when the value is allocated here but never
+  // outlives the function, so it can live on the stack.
+  bool isOnStack = false;
 };
 
 struct VariableReference {
-  StringView name;
-
-  static Expression make(StringView name) {
-    return Unique<VariableReference>(
-        new VariableReference{.name = std::move(name)});
-  }
+  Symbol name;
+  Location location;
 };
 
 struct FunctionCall {
-  StringView name;
-  Vector<Expression> args;
+  Symbol name;
+  Range<Expression> args;
+  Location location;
+  // Set by the Analyzer on a fork() that is the last use of its variable,
+  // which then moves the value instead of adding a reference to it.
+  bool isMove = false;
+};
 
-  static Statement makeStatement(StringView name, Vector<Expression> args) {
-    return Unique<FunctionCall>(
-        new FunctionCall{.name = std::move(name), .args = std::move(args)});
-  }
+// Number whose value is known at compile time.
+struct Constant {
+  // INT or FLOAT, or VOID when the value isn't known.
+  BaseType type = BaseType::VOID;
+  union {
+    int64_t intValue = 0;
+    double floatValue;
+  };
 
-  static Expression makeExpression(StringView name, Vector<Expression> args) {
-    return Unique<FunctionCall>(
-        new FunctionCall{.name = std::move(name), .args = std::move(args)});
+  bool isKnown() const { return this->type != BaseType::VOID; }
+
+  // Formats the value so C reads it back as the same type.
+  String toString() const {
+    if (this->type == BaseType::INT) {
+      return std::to_string(this->intValue);
+    }
+    String text = std::format("{}", this->floatValue);
+    if (text.find_first_of(".e") == String::npos) {
+      text += ".0";
+    }
+    return text;
   }
 };
 
 struct NumberLiteral {
+  // Text of the literal, which is empty for numbers computed by the compiler.
   StringView value;
-
-  static Expression make(StringView value) {
-    return Unique<NumberLiteral>(new NumberLiteral{.value = std::move(value)});
-  }
+  Location location;
+  // Value of the literal, known once constant folding parsed it.
+  Constant constant;
 };
 
 struct StringLiteral {
   StringView value;
+  Location location;
+};
 
-  static Expression make(StringView value) {
-    return Unique<StringLiteral>(new StringLiteral{.value = std::move(value)});
-  }
+struct BinaryExpression {
+  BinaryOperator op;
+  Expression left;
+  Expression right;
+  // Location of the operator.
+  Location location;
 };
 
 struct Return {
   Optional<Expression> expression;
-
-  static Statement makeStatement(Optional<Expression> expression) {
-    return Unique<Return>(new Return{.expression = std::move(expression)});
-  }
+  Location location;
 };
 
 struct StatementBlock {
-  Vector<Statement> statements;
+  Range<Statement> statements;
+  // Location of the opening brace.
+  Location location;
 };
 
 struct FunctionDeclaration {
-  StringView name;
-  Vector<FunctionParameter> params;
+  Symbol name;
+  Range<FunctionParameter> params;
   Type returnType;
   StatementBlock body;
+  // Location of the function name.
+  Location location;
+  // Location of the return type, or the function name if it was omitted.
+  Location returnTypeLocation;
+  // Whether the function is declared with pub, which keeps it in the program
+  // even if nothing calls it.
+  bool isExported = false;
 };
 
+// Storage for every node of a program, which serves as its arena: the
+// Program owns it, and every node is freed at once along with it. Each node
+// kind lives in its own contiguous pool, and nodes refer to their children by
+// 32-bit index rather than by pointer. Child lists are ranges into arrays
+// shared by the whole program. getNodeCount(), getBytesUsed() and
+// getBytesReserved() report how much it holds, to help size the pools.
+struct Ast {
+#define NODE_POOL_GENERATOR(KIND, TYPE) Vector<TYPE>,
+  std::tuple<FOREACH_NODE_KIND(NODE_POOL_GENERATOR) Vector<Statement>,
+             Vector<Expression>, Vector<FunctionParameter>>
+      pools;
+
+  // Pool holding every node or child list element of the given type.
+  template <typename T>
+  Vector<T>& getPool() {
+    return std::get<Vector<T>>(this->pools);
+  }
+
+  template <typename T>
+  const Vector<T>& getPool() const {
+    return std::get<Vector<T>>(this->pools);
+  }
+
+  // Adds the node to its pool, returning a handle to it.
+  template <typename Handle, typename T>
+  Handle add(T node) {
+    static_assert(canRefer<Handle, T>,
+                  "Node type can't be referred to by this kind of handle.");
+    Vector<T>& pool = this->getPool<T>();
+    pool.push_back(std::move(node));
+    return Handle{.kind = nodeKindOf<T>, .index = (uint32_t)(pool.size() - 1)};
+  }
+
+  template <typename T>
+  Statement addStatement(T node) {
+    return this->add<Statement>(std::move(node));
+  }
+
+  template <typename T>
+  Expression addExpression(T node) {
+    return this->add<Expression>(std::move(node));
+  }
+
+  // Moves the elements from the given start of the scratch list to the end of
+  // the shared array, returning their range. Lists are built up in a scratch
+  // list first, since nested lists are parsed before their parent's list is
+  // complete.
+  template <typename T>
+  Range<T> addRange(Vector<T>& scratch, size_t scratchStart) {
+    Vector<T>& array = this->getPool<T>();
+    Range<T> range = {.start = (uint32_t)array.size(),
+                      .count = (uint32_t)(scratch.size() - scratchStart)};
+    array.insert(array.end(), scratch.begin() + scratchStart, scratch.end());
+    scratch.resize(scratchStart);
+    return range;
+  }
+
+  // Returns the node that the handle refers to.
+  template <typename T, typename Tag>
+  T& get(NodeHandle<Tag> handle) {
+    return this->getPool<T>()[handle.index];
+  }
+
+  template <typename T, typename Tag>
+  const T& get(NodeHandle<Tag> handle) const {
+    return this->getPool<T>()[handle.index];
+  }
+
+  // Returns the elements of a child list. The span is invalidated when more
+  // elements are added to the same array.
+  template <typename T>
+  Span<T> get(Range<T> range) {
+    return Span<T>(this->getPool<T>().data() + range.start, range.count);
+  }
+
+  template <typename T>
+  Span<const T> get(Range<T> range) const {
+    return Span<const T>(this->getPool<T>().data() + range.start, range.count);
+  }
+
+  // Releases the unused capacity of every pool once no more nodes will be
+  // added.
+  void shrinkToFit() {
+    std::apply([](auto&... pool) { (pool.shrink_to_fit(), ...); },
+               this->pools);
+  }
+
+  // Number of nodes in every pool, not counting child list elements.
+  size_t getNodeCount() const {
+    size_t count = 0;
+#define NODE_COUNT_GENERATOR(KIND, TYPE) count += this->getPool<TYPE>().size();
+    FOREACH_NODE_KIND(NODE_COUNT_GENERATOR)
+    return count;
+  }
+
+  // Bytes taken up by nodes and child list elements.
+  size_t getBytesUsed() const {
+    size_t bytes = 0;
+    std::apply(
+        [&](const auto&... pool) {
+          ((bytes += pool.size() * sizeof(pool[0])), ...);
+        },
+        this->pools);
+    return bytes;
+  }
+
+  // Bytes reserved by all pools, including their unused capacity.
+  size_t getBytesReserved() const {
+    size_t bytes = 0;
+    std::apply(
+        [&](const auto&... pool) {
+          ((bytes += pool.capacity() * sizeof(pool[0])), ...);
+        },
+        this->pools);
+    return bytes;
+  }
+};
+
+// Combines lambdas into a single visitor with an overload for each of them.
+template <typename... Handlers>
+struct Overloaded : Handlers... {
+  using Handlers::operator()...;
+};
+
+#define VISIT_CHECK_GENERATOR(KIND, TYPE)                                   \
+  static_assert(                                                            \
+      std::is_invocable_v<Visitor, decltype(ast.template get<TYPE>(node))>, \
+      "Visitor has no handler for " #TYPE ".");
+#define VISIT_CASE_GENERATOR(KIND, TYPE) \
+  case NodeKind::KIND:                   \
+    return visitor(ast.template get<TYPE>(node));
+
+// Calls the visitor with the node that the statement refers to. Handlers are
+// picked at compile time, so this is a single switch on the node kind, and a
+// visitor missing a handler for any statement kind doesn't compile. Visitors
+// that only care about some kinds can add a generic handler for the rest.
+template <typename AstType, typename Visitor>
+decltype(auto) visit(AstType& ast, Statement node, Visitor&& visitor) {
+  FOREACH_STATEMENT_KIND(VISIT_CHECK_GENERATOR)
+  switch (node.kind) {
+    FOREACH_STATEMENT_KIND(VISIT_CASE_GENERATOR)
+    default:
+      __builtin_unreachable();
+  }
+}
+
+// Calls the visitor with the node that the expression refers to, in the same
+// way as for statements.
+template <typename AstType, typename Visitor>
+decltype(auto) visit(AstType& ast, Expression node, Visitor&& visitor) {
+  FOREACH_EXPRESSION_KIND(VISIT_CHECK_GENERATOR)
+  switch (node.kind) {
+    FOREACH_EXPRESSION_KIND(VISIT_CASE_GENERATOR)
+    default:
+      __builtin_unreachable();
+  }
+}
+
 struct Program {
-  Vector<String> includes;
+  OrderedSet<String> includes;
   Vector<FunctionDeclaration> functions;
+  // Storage for every node and child list of the program.
+  Ast ast;
+  // Calls between the functions, built by the Analyzer.
+  CallGraph callGraph;
+  // Warnings found by the Analyzer, which don't stop the program compiling.
+  Vector<ErrorId> warnings;
+  // Bytes of source the program was parsed from, which output buffers are
+  // sized from.
+  size_t sourceSize = 0;
 };
 
 #endif  // AST_CC
\ No newline at end of file
@@ -3,93 +3,101 @@
 
 #include "ast.cc"
 #include "builtins.cc"
+#include "output_buffer.cc"
+
+// Bytes of AST dump per byte of source, which has a line per node.
+const size_t AST_DUMP_SIZE_PER_SOURCE_BYTE = 3;
 
 struct AstPrinter {
-  StringStream out;
+  OutputBuffer out;
+  // Storage of the nodes of the program being printed.
+  const Ast* ast;
 
   Result<String> printProgram(const Program& node) {
+    this->ast = &node.ast;
     // Empty the output buffer in case this was called before.
-    out.str("");
+    this->out = OutputBuffer();
+    this->out.reserve(node.sourceSize * AST_DUMP_SIZE_PER_SOURCE_BYTE);
     for (size_t i = 0; i < node.functions.size(); i++) {
       TRY(this->printFunctionDeclaration(node.functions[i], 0));
-      if (i < node.functions.size() - 1) {
-        out << "\n";
-      }
     }
-    return Ok(out.str());
-  }
-
-  void indent(int level) {
-    for (int i = 0; i < level; i++) {
-      this->out << "  ";
+    // Every node ends its last line, so drop the final newline.
+    String result = this->out.take();
+    if (!result.empty() && result.back() == '\n') {
+      result.pop_back();
     }
+    return Ok(result);
   }
 
+  void indent(int level) { this->out.writeIndent(level * 2); }
+
   Result<None> printFunctionDeclaration(const FunctionDeclaration& node,
                                         int level) {
     this->indent(level);
-    this->out << "FunctionDeclaration: " << node.name << "\n";
+    this->out.write("FunctionDeclaration: ");
+    this->out.write(symbolTable.getName(node.name));
+    this->out.write(node.isExported ? " (pub)\n" : "\n");
 
     this->indent(level + 1);
-    this->out << "params:\n";
-    for (size_t i = 0; i < node.params.size(); i++) {
+    this->out.write("params:\n");
+    for (const auto& param : this->ast->get(node.params)) {
       this->indent(level + 2);
-      this->out << node.params[i].name << ": ";
-      TRY(this->printType(node.params[i].type));
-      this->out << "\n";
+      this->out.write(symbolTable.getName(param.name));
+      this->out.write(": ");
+      TRY(this->printType(param.type));
+      this->out.writeChar('\n');
     }
 
     this->indent(level + 1);
-    this->out << "returnType: ";
+    this->out.write("returnType: ");
     TRY(this->printType(node.returnType));
-    this->out << "\n";
+    this->out.writeChar('\n');
 
     this->indent(level + 1);
-    this->out << "body:\n";
+    this->out.write("body:\n");
     TRY(this->printStatementBlock(node.body, level + 2));
 
     return Ok();
   }
 
   Result<None> printStatementBlock(const StatementBlock& node, int level) {
-    for (size_t i = 0; i < node.statements.size(); i++) {
-      TRY(this->printStatement(node.statements[i], level));
+    for (const auto& statement : this->ast->get(node.statements)) {
+      TRY(this->printStatement(statement, level));
     }
     return Ok();
   }
 
   Result<None> printStatement(const Statement& node, int level) {
-    if (std::holds_alternative<Unique<FunctionCall>>(node)) {
-      TRY(this->printFunctionCall(*std::get<Unique<FunctionCall>>(node),
-                                  level));
-      return Ok();
-    }
-    if (std::holds_alternative<Unique<Return>>(node)) {
-      TRY(this->printReturn(*std::get<Unique<Return>>(node), level));
-      return Ok();
-    }
-    return Error("Unexpected Statement of index {} when converting to String.",
-                 node.index());
+    return visit(*this->ast, node,
+                 Overloaded{[&](const VariableDeclaration& node) {
+                              return this->printVariableDeclaration(node,
+                                                                    level);
+                            },
+                            [&](const FunctionCall& node) {
+                              return this->printFunctionCall(node, level);
+                            },
+                            [&](const Return& node) {
+                              return this->printReturn(node, level);
+                            }});
   }
 
   Result<None> printExpression(const Expression& node, int level) {
-    if (std::holds_alternative<Unique<FunctionCall>>(node)) {
-      TRY(this->printFunctionCall(*std::get<Unique<FunctionCall>>(node),
-                                  level));
-      return Ok();
-    }
-    if (std::holds_alternative<Unique<NumberLiteral>>(node)) {
-      TRY(this->printNumberLiteral(*std::get<Unique<NumberLiteral>>(node),
-                                   level));
-      return Ok();
-    }
-    if (std::holds_alternative<Unique<StringLiteral>>(node)) {
-      TRY(this->printStringLiteral(*std::get<Unique<StringLiteral>>(node),
-                                   level));
-      return Ok();
-    }
-    return Error("Unexpected Expression of index {} when converting to String.",
-                 node.index());
+    return visit(*this->ast, node,
+                 Overloaded{[&](const VariableReference& node) {
+                              return this->printVariableReference(node, level);
+                            },
+                            [&](const FunctionCall& node) {
+                              return this->printFunctionCall(node, level);
+                            },
+                            [&](const NumberLiteral& node) {
+                              return this->printNumberLiteral(node, level);
+                            },
+                            [&](const StringLiteral& node) {
+                              return this->printStringLiteral(node, level);
+                            },
+                            [&](const BinaryExpression& node) {
+                              return this->printBinaryExpression(node, level);
+                            }});
   }
 
   Result<None> printType(const Type& type) {
@@ -105,47 +113,83 @@ struct AstPrinter {
   }
 
   Result<None> printListType(const ListType& listType) {
-    this->out << "[";
+    this->out.writeChar('[');
     TRY(this->printBaseType(listType.elementType));
-    this->out << "]";
+    this->out.writeChar(']');
     return Ok();
   }
 
   Result<None> printBaseType(const BaseType& type) {
-    this->out << baseTypeToString(type);
+    this->out.write(baseTypeToString(type));
+    return Ok();
+  }
+
+  Result<None> printVariableDeclaration(const VariableDeclaration& node,
+                                        int level) {
+    this->indent(level);
+    this->out.write("VariableDeclaration: ");
+    this->out.write(symbolTable.getName(node.name));
+    if (node.hasDeclaredType) {
+      this->out.write(": ");
+      TRY(this->printType(node.type));
+    }
+    this->out.writeChar('\n');
+    TRY(this->printExpression(node.expression, level + 1));
     return Ok();
   }
 
   Result<None> printFunctionCall(const FunctionCall& node, int level) {
     this->indent(level);
-    this->out << "FunctionCall: " << node.name << "\n";
+    this->out.write("FunctionCall: ");
+    this->out.write(symbolTable.getName(node.name));
+    this->out.writeChar('\n');
 
-    for (size_t i = 0; i < node.args.size(); i++) {
-      TRY(this->printExpression(node.args[i], level + 1));
+    for (const auto& arg : this->ast->get(node.args)) {
+      TRY(this->printExpression(arg, level + 1));
     }
     return Ok();
   }
 
+  Result<None> printVariableReference(const VariableReference& node,
+                                      int level) {
+    this->indent(level);
+    this->out.write(symbolTable.getName(node.name));
+    this->out.writeChar('\n');
+    return Ok();
+  }
+
   Result<None> printNumberLiteral(const NumberLiteral& node, int level) {
     this->indent(level);
-    this->out << node.value;
+    this->out.write(node.value);
+    this->out.writeChar('\n');
     return Ok();
   }
 
   Result<None> printStringLiteral(const StringLiteral& node, int level) {
     this->indent(level);
-    this->out << node.value;
+    this->out.write(node.value);
+    this->out.writeChar('\n');
+    return Ok();
+  }
+
+  Result<None> printBinaryExpression(const BinaryExpression& node, int level) {
+    this->indent(level);
+    this->out.write("BinaryExpression: ");
+    this->out.write(binaryOperatorToString(node.op));
+    this->out.writeChar('\n');
+    TRY(this->printExpression(node.left, level + 1));
+    TRY(this->printExpression(node.right, level + 1));
     return Ok();
   }
 
   Result<None> printReturn(const Return& node, int level) {
     this->indent(level);
-    this->out << "Return:\n";
+    this->out.write("Return:\n");
     if (node.expression.has_value()) {
       TRY(this->printExpression(node.expression.value(), level + 1));
     } else {
       this->indent(level + 1);
-      this->out << "VOID";
+      this->out.write("VOID\n");
     }
     return Ok();
   }
@@ -0,0 +1,1028 @@
+#ifndef BENCH_CC
+#define BENCH_CC
+
+/*
+Run benchmarks:
+clang++ -O2 -Wextra -Werror -std=c++20 bench.cc -o build/bench && ./build/bench
+
+Pass a benchmark name to only run that one, e.g. ./build/bench tokenizer
+*/
+#include <chrono>
+
+#include "analyzer.cc"
+#include "ast_printer.cc"
+#include "builtins.cc"
+#include "bytecode_compiler.cc"
+#include "compiler.cc"
+#include "dead_function_elimination.cc"
+#include "escape_analysis.cc"
+#include "inliner.cc"
+#include "mir_builder.cc"
+#include "mir_compiler.cc"
+#include "mir_passes.cc"
+#include "parallel_tokenizer.cc"
+#include "parser.cc"
+#include "scan.cc"
+#include "split_compiler.cc"
+#include "thread_pool.cc"
+#include "tokenizer.cc"
+#include "vm.cc"
+
+// Generates Nuo code resembling our large generated sources, made up of many
+// small top-level functions.
+String generateSource(size_t functionCount) {
+  StringStream source;
+  for (size_t i = 0; i < functionCount; i++) {
+    source << "fn generated_helper_function_" << i
+           << "(first_parameter: int, second_parameter: float): int {\n";
+    source << "  println(\"generated helper function number " << i
+           << " was called with some arguments\")\n";
+    source << "  return " << i * 7919 << "\n";
+    source << "}\n\n";
+  }
+  return source.str();
+}
+
+// Runs the given function repeatedly for at least the minimum duration and
+// returns the fastest run in seconds, which is the least affected by noise
+// from the rest of the machine.
+template <typename Function>
+double measureSeconds(Function function) {
+  using Clock = std::chrono::steady_clock;
+  const auto minimumDuration = std::chrono::milliseconds(500);
+  Clock::time_point start = Clock::now();
+  Clock::duration fastest = Clock::duration::max();
+  do {
+    Clock::time_point runStart = Clock::now();
+    function();
+    fastest = std::min(fastest, Clock::now() - runStart);
+  } while (Clock::now() - start < minimumDuration);
+  return std::chrono::duration<double>(fastest).count();
+}
+
+// Prints the throughput of processing the given number of bytes in MB/s.
+void printThroughput(StringView name, size_t bytes, double seconds) {
+  print("  {}: {:.1f} MB/s", name, bytes / seconds / 1e6);
+}
+
+// Parses and analyzes the source, printing the error if either fails.
+Optional<Program> parseAndAnalyze(StringView source) {
+  Parser parser(source);
+  Result<Program> program = parser.parse();
+  if (!program.ok) {
+    print("  {}", program.getError());
+    return std::nullopt;
+  }
+  Analyzer analyzer;
+  Result<None> result = analyzer.analyzeProgram(program.value);
+  if (!result.ok) {
+    print("  {}", result.getError());
+    return std::nullopt;
+  }
+  return std::move(program.value);
+}
+
+// Prevents the compiler from optimizing away benchmarked work.
+template <typename T>
+void keepAlive(const T& value) {
+  asm volatile("" : : "r"(&value) : "memory");
+}
+
+// Tokenizes the code one token at a time until the end, returning the number
+// of tokens seen.
+size_t tokenizeEach(StringView code) {
+  Tokenizer tokenizer(code);
+  size_t count = 0;
+  while (true) {
+    Result<Token> token = tokenizer.next();
+    count++;
+    if (!token.ok || token.value.type == TokenType::END) {
+      break;
+    }
+  }
+  return count;
+}
+
+void benchmarkTokenizer() {
+  String source = generateSource(20000);
+  print("tokenizer ({} bytes)", source.size());
+
+  ScanImplementation bestImplementation = scanImplementation;
+  for (ScanImplementation implementation :
+       {ScanImplementation::SCALAR, ScanImplementation::SSE2,
+        ScanImplementation::AVX2}) {
+    if (!isScanImplementationSupported(implementation)) {
+      continue;
+    }
+    scanImplementation = implementation;
+    double seconds = measureSeconds([&]() { keepAlive(tokenizeEach(source)); });
+    printThroughput(
+        std::format("next() {}", scanImplementationToString(implementation)),
+        source.size(), seconds);
+
+    seconds = measureSeconds([&]() {
+      Result<TokenBuffer> tokens = Tokenizer(source).tokenize();
+      keepAlive(tokens.value.size());
+    });
+    printThroughput(std::format("tokenize() {}",
+                                scanImplementationToString(implementation)),
+                    source.size(), seconds);
+  }
+  scanImplementation = bestImplementation;
+}
+
+// Keyword recognizer that the tokenizer used before the perfect hash table,
+// kept as a baseline. It walks a hand-written trie one character at a time,
+// then rescans the rest of the identifier when no keyword matched.
+struct TrieKeywordMatcher {
+  StringView code;
+  size_t end = 0;
+
+  char peekChar() {
+    return this->isAtEnd() ? '\0' : this->code[this->end];
+  }
+
+  void consumeChar() { this->end++; }
+
+  bool matchChar(char c) {
+    if (this->peekChar() == c) {
+      this->consumeChar();
+      return true;
+    }
+    return false;
+  }
+
+  bool isAtEnd() { return this->end >= this->code.length(); }
+
+  bool isAlpha(char c) {
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_';
+  }
+
+  bool isDigit(char c) { return c >= '0' && c <= '9'; }
+
+  bool isIdentifierChar() {
+    return this->isAlpha(this->peekChar()) || this->isDigit(this->peekChar());
+  }
+
+  TokenType getType() {
+    if (this->matchChar('e')) {
+      // token: e
+      if (this->matchChar('l')) {
+        // token: el
+        if (this->matchChar('i')) {
+          // token: eli
+          if (this->matchChar('f')) {
+            // token: elif
+            if (!this->isIdentifierChar()) {
+              // token: elif<end>
+              return TokenType::ELIF;
+            }
+          }
+        } else if (this->matchChar('s')) {
+          // token: els
+          if (this->matchChar('e')) {
+            // token: else
+            if (!this->isIdentifierChar()) {
+              // token: else<end>
+              return TokenType::ELSE;
+            }
+          }
+        }
+      }
+    } else if (this->matchChar('f')) {
+      // token: f
+      if (this->matchChar('l')) {
+        // token: fl
+        if (this->matchChar('o')) {
+          // token: flo
+          if (this->matchChar('a')) {
+            // token: floa
+            if (this->matchChar('t')) {
+              // token: float
+              if (!this->isIdentifierChar()) {
+                // token: float<end>
+                return TokenType::FLOAT;
+              }
+            }
+          }
+        }
+      } else if (this->matchChar('n')) {
+        // token: fn
+        if (!this->isIdentifierChar()) {
+          // token: fn<end>
+          return TokenType::FN;
+        }
+      } else if (this->matchChar('o')) {
+        // token: fo
+        if (this->matchChar('r')) {
+          // token: for
+          if (!this->isIdentifierChar()) {
+            // token: for<end>
+            return TokenType::FOR;
+          }
+        }
+      }
+    } else if (this->matchChar('i')) {
+      // token: i
+      if (this->matchChar('f')) {
+        // token: if
+        if (!this->isIdentifierChar()) {
+          // token: if<end>
+          return TokenType::IF;
+        }
+      } else if (this->matchChar('n')) {
+        // token: in
+        if (this->matchChar('t')) {
+          // token: int
+          if (!this->isIdentifierChar()) {
+            // token: int<end>
+            return TokenType::INT;
+          }
+        }
+      }
+    } else if (this->matchChar('r')) {
+      // token: r
+      if (this->matchChar('e')) {
+        // token: re
+        if (this->matchChar('t')) {
+          // token: ret
+          if (this->matchChar('u')) {
+            // token: retu
+            if (this->matchChar('r')) {
+              // token: retur
+              if (this->matchChar('n')) {
+                // token: return
+                if (!this->isIdentifierChar()) {
+                  // token: return<end>
+                  return TokenType::RETURN;
+                }
+              }
+            }
+          }
+        }
+      }
+    }
+    // Since we didn't match any keywords, we have a user-defined identifier.
+    // Consume all remaining alphabet or digit tokens.
+    this->end = scan<IdentifierClass>(this->code, this->end);
+    return TokenType::IDENTIFIER;
+  }
+};
+
+// Generates code where newlines often fall within string literals or
+// parenthesis, which the parallel tokenizer must not split at.
+String generateMultilineSource(size_t functionCount) {
+  StringStream source;
+  for (size_t i = 0; i < functionCount; i++) {
+    source << "fn multiline_" << i << "() {\n";
+    source << "  println(\"first line\n(second line\n\", (\n    x" << i
+           << ",\n    \")\"))\n";
+    source << "}\n";
+  }
+  return source.str();
+}
+
+void benchmarkParallelTokenizer() {
+  String multilineSource = generateMultilineSource(100000);
+  Result<TokenBuffer> multilineTokens = Tokenizer(multilineSource).tokenize();
+  for (size_t threads : {2, 3, 8, 64}) {
+    Result<TokenBuffer> tokens =
+        tokenizeParallel(multilineSource, threads, 1 << 10);
+    if (!tokens.ok || !tokens.value.equals(multilineTokens.value)) {
+      print("Multiline tokens differ from the serial tokenizer with {} threads!",
+            threads);
+    }
+  }
+
+  String source = generateSource(200000);
+  print("parallel tokenizer ({} bytes)", source.size());
+
+  Result<TokenBuffer> serialTokens = Tokenizer(source).tokenize();
+  double seconds = measureSeconds([&]() {
+    Result<TokenBuffer> tokens = Tokenizer(source).tokenize();
+    keepAlive(tokens.value.size());
+  });
+  printThroughput("serial", source.size(), seconds);
+
+  size_t maxThreads = std::max(8u, std::thread::hardware_concurrency());
+  for (size_t threads = 1; threads <= maxThreads; threads *= 2) {
+    Result<TokenBuffer> tokens = tokenizeParallel(source, threads);
+    if (!tokens.ok || !tokens.value.equals(serialTokens.value)) {
+      print("  {} threads: tokens differ from the serial tokenizer!", threads);
+      continue;
+    }
+    seconds = measureSeconds([&]() {
+      Result<TokenBuffer> tokens = tokenizeParallel(source, threads);
+      keepAlive(tokens.value.size());
+    });
+    printThroughput(std::format("{} threads", threads), source.size(),
+                    seconds);
+  }
+}
+
+// Generates a list of identifiers, mixing keywords with identifiers that share
+// their prefixes.
+Vector<String> generateIdentifiers(size_t count) {
+  const char* words[] = {"fn",     "return", "if",       "elif",   "else",
+                         "for",    "int",    "float",    "format", "iffy",
+                         "elapse", "forty",  "interval", "floor",  "result",
+                         "value",  "x",      "index",    "name",   "counter"};
+  Vector<String> identifiers;
+  for (size_t i = 0; i < count; i++) {
+    identifiers.push_back(words[(i * 7) % std::size(words)]);
+  }
+  return identifiers;
+}
+
+void benchmarkKeywords() {
+  Vector<String> identifiers = generateIdentifiers(100000);
+  size_t bytes = 0;
+  for (const auto& identifier : identifiers) {
+    bytes += identifier.size();
+  }
+  print("keywords ({} identifiers)", identifiers.size());
+
+  double seconds = measureSeconds([&]() {
+    size_t keywordCount = 0;
+    for (const auto& identifier : identifiers) {
+      TrieKeywordMatcher matcher{.code = identifier};
+      keywordCount += matcher.getType() != TokenType::IDENTIFIER;
+    }
+    keepAlive(keywordCount);
+  });
+  printThroughput("trie", bytes, seconds);
+
+  seconds = measureSeconds([&]() {
+    size_t keywordCount = 0;
+    for (const auto& identifier : identifiers) {
+      keywordCount += getKeywordType(identifier) != TokenType::IDENTIFIER;
+    }
+    keepAlive(keywordCount);
+  });
+  printThroughput("perfect hash", bytes, seconds);
+
+  String source;
+  for (const auto& identifier : identifiers) {
+    source += identifier;
+    source += ' ';
+  }
+  seconds = measureSeconds([&]() {
+    Result<TokenBuffer> tokens = Tokenizer(source).tokenize();
+    keepAlive(tokens.value.size());
+  });
+  printThroughput("tokenize()", source.size(), seconds);
+}
+
+void benchmarkParser() {
+  String source = generateSource(20000);
+  print("parser ({} bytes)", source.size());
+
+  double seconds = measureSeconds([&]() {
+    Parser parser(source);
+    Result<Program> program = parser.parse();
+    keepAlive(program.value.functions.size());
+  });
+  printThroughput("parse()", source.size(), seconds);
+}
+
+// Generates a function returning one expression with the given number of
+// terms, where every term opens another level of parentheses.
+String generateNestedExpressionSource(size_t termCount) {
+  StringStream source;
+  source << "fn nested(x: int): int {\n  return ";
+  for (size_t i = 0; i < termCount; i++) {
+    source << "x + " << i << " - (";
+  }
+  source << "x";
+  for (size_t i = 0; i < termCount; i++) {
+    source << ")";
+  }
+  source << "\n}\n";
+  return source.str();
+}
+
+void benchmarkExpressions() {
+  // The innermost term takes three levels, and every other term adds one.
+  String source = generateNestedExpressionSource(MAX_EXPRESSION_DEPTH - 2);
+  print("expressions ({} bytes, {} levels deep)", source.size(),
+        MAX_EXPRESSION_DEPTH);
+
+  double seconds = measureSeconds([&]() {
+    Parser parser(source);
+    Result<Program> program = parser.parse();
+    keepAlive(program.value.ast.getNodeCount());
+  });
+  printThroughput("parse()", source.size(), seconds);
+
+  // The passes after the parser recurse for every level, so the deepest
+  // expression the parser allows must get through each of them.
+  Optional<Program> parsed = parseAndAnalyze(source);
+  if (!parsed.has_value()) {
+    return;
+  }
+  Program& program = parsed.value();
+  seconds = measureSeconds([&]() {
+    program.includes.clear();
+    program.warnings.clear();
+    Analyzer analyzer;
+    keepAlive(analyzer.analyzeProgram(program).ok);
+  });
+  printThroughput("analyzeProgram()", source.size(), seconds);
+  seconds = measureSeconds([&]() {
+    ConstantFolder constantFolder;
+    constantFolder.foldProgram(program);
+    keepAlive(constantFolder.foldedCount);
+  });
+  printThroughput("foldProgram()", source.size(), seconds);
+  seconds = measureSeconds(
+      [&]() { keepAlive(Compiler().compileProgram(program).ok); });
+  printThroughput("compileProgram()", source.size(), seconds);
+  seconds = measureSeconds(
+      [&]() { keepAlive(MirBuilder().buildProgram(program).ok); });
+  printThroughput("buildProgram()", source.size(), seconds);
+
+  String tooDeepSource =
+      generateNestedExpressionSource(MAX_EXPRESSION_DEPTH - 1);
+  Parser parser(tooDeepSource);
+  Result<Program> tooDeep = parser.parse();
+  print("  one level deeper: {}", tooDeep.ok ? "parsed" : tooDeep.getError());
+}
+
+// Parses many small programs, every other one ending in a syntax error, to
+// weigh the cost of passing Results around against the work done.
+void benchmarkResults() {
+  Vector<String> sources;
+  for (size_t i = 0; i < 10000; i++) {
+    StringStream source;
+    source << "fn small_" << i << "(x: int): int {\n";
+    source << "  println(x + " << i << " - (x - 1))\n";
+    source << "  return x\n";
+    source << (i % 2 == 0 ? "}\n" : "  return )\n}\n");
+    sources.push_back(source.str());
+  }
+  size_t bytes = 0;
+  for (const auto& source : sources) {
+    bytes += source.size();
+  }
+  print("results ({} programs, {} bytes)", sources.size(), bytes);
+
+  double seconds = measureSeconds([&]() {
+    DiagnosticsScope diagnosticsScope;
+    size_t failures = 0;
+    for (const auto& source : sources) {
+      Parser parser(source);
+      Result<Program> program = parser.parse();
+      failures += !program.ok;
+    }
+    keepAlive(failures);
+  });
+  printThroughput("parse()", bytes, seconds);
+}
+
+void benchmarkAnalyzer() {
+  print("analyzer");
+  for (size_t functionCount : {12500, 25000, 50000}) {
+    String source = generateSource(functionCount);
+    Parser parser(source);
+    Result<Program> program = parser.parse();
+
+    double seconds = measureSeconds([&]() {
+      program.value.includes.clear();
+      Analyzer analyzer;
+      Result<None> result = analyzer.analyzeProgram(program.value);
+      keepAlive(result.ok);
+    });
+    print("  {} functions: {:.2f} ms, {:.0f} ns per function", functionCount,
+          seconds * 1e3, seconds * 1e9 / functionCount);
+  }
+}
+
+// Analyzes the program on the given pool, or serially without one, returning
+// the error or the includes it found.
+String analyzeWith(StringView source, ThreadPool* threadPool) {
+  Parser parser(source);
+  Result<Program> program = parser.parse();
+  Analyzer analyzer = {.threadPool = threadPool};
+  Result<None> result = analyzer.analyzeProgram(program.value);
+  if (!result.ok) {
+    return result.getError();
+  }
+  String includes;
+  for (const auto& include : program.value.includes) {
+    includes += include + "\n";
+  }
+  return includes;
+}
+
+void benchmarkParallelAnalyzer() {
+  String source = generateSource(50000);
+  Parser parser(source);
+  Result<Program> program = parser.parse();
+  print("parallel analyzer ({} functions)", program.value.functions.size());
+
+  double serialSeconds = measureSeconds([&]() {
+    program.value.includes.clear();
+    Analyzer analyzer;
+    Result<None> result = analyzer.analyzeProgram(program.value);
+    keepAlive(result.ok);
+  });
+  print("  serial: {:.2f} ms", serialSeconds * 1e3);
+
+  String serialOutput = analyzeWith(source, nullptr);
+  size_t maxThreads = std::max(8u, std::thread::hardware_concurrency());
+  for (size_t threads = 1; threads <= maxThreads; threads *= 2) {
+    ThreadPool threadPool(threads);
+    if (analyzeWith(source, &threadPool) != serialOutput) {
+      print("  {} threads: output differs from the serial analyzer!",
+            threads);
+      continue;
+    }
+    double seconds = measureSeconds([&]() {
+      program.value.includes.clear();
+      Analyzer analyzer = {.threadPool = &threadPool};
+      Result<None> result = analyzer.analyzeProgram(program.value);
+      keepAlive(result.ok);
+    });
+    print("  {} threads: {:.2f} ms, {:.2f}x serial", threads, seconds * 1e3,
+          serialSeconds / seconds);
+  }
+}
+
+// Generates a library of helpers where main only ends up calling every tenth
+// one, like a program pulling in a large helper library.
+String generateLibrarySource(size_t functionCount) {
+  String source = "fn main(): int {\n  return helper0(1)\n}\n";
+  for (size_t i = 0; i < functionCount; i++) {
+    String call = i + 10 < functionCount
+                      ? std::format("helper{}(x) + 1", i + 10)
+                      : String("x");
+    source += std::format("\nfn helper{}(x: int): int {{\n  return {}\n}}\n",
+                          i, call);
+  }
+  return source;
+}
+
+void benchmarkDeadFunctions() {
+  String source = generateLibrarySource(50000);
+  print("dead functions ({} bytes)", source.size());
+
+  Optional<Program> parsed = parseAndAnalyze(source);
+  if (!parsed.has_value()) {
+    return;
+  }
+  Program& program = parsed.value();
+  Result<String> fullOutput = Compiler().compileProgram(program);
+
+  Program copy = program;
+  double seconds = measureSeconds([&]() {
+    copy.functions = program.functions;
+    copy.callGraph = program.callGraph;
+    keepAlive(eliminateDeadFunctions(copy));
+  });
+  Result<String> output = Compiler().compileProgram(copy);
+  print("  {} of {} functions kept, {} calls in the graph",
+        copy.functions.size(), program.functions.size(),
+        program.callGraph.callees.size());
+  print("  C output: {} bytes before, {} bytes after", fullOutput.value.size(),
+        output.value.size());
+  print("  eliminateDeadFunctions() and copying the functions: {:.2f} ms",
+        seconds * 1e3);
+}
+
+// Generates functions that fork strings, some of them for the last time.
+String generateForkingSource(size_t functionCount) {
+  String source = "fn main() {\n  return\n}\n";
+  for (size_t i = 0; i < functionCount; i++) {
+    source += std::format(
+        "\npub fn use{}(text: string): string {{\n"
+        "  first := fork(text)\n"
+        "  second := fork(text)\n"
+        "  println(first)\n"
+        "  return fork(second)\n"
+        "}}\n",
+        i);
+  }
+  return source;
+}
+
+void benchmarkRefcounts() {
+  String source = generateForkingSource(20000);
+  Parser parser(source);
+  Result<Program> program = parser.parse();
+  print("refcounts ({} functions)", program.value.functions.size());
+
+  double seconds = measureSeconds([&]() {
+    DiagnosticsScope diagnosticsScope;
+    program.value.includes.clear();
+    program.value.warnings.clear();
+    Analyzer analyzer;
+    Result<None> result = analyzer.analyzeProgram(program.value);
+    keepAlive(result.ok);
+  });
+
+  // Counted statically over every fork in the source, including those in
+  // functions that never run. Codegen emits no reference counting yet, so
+  // there are no runtime operations to count.
+  size_t forkCount = 0;
+  size_t moveCount = 0;
+  for (const auto& call : program.value.ast.getPool<FunctionCall>()) {
+    if (call.name == Symbol::FORK) {
+      forkCount++;
+      moveCount += call.isMove;
+    }
+  }
+  print("  static forks turned into moves: {} of {}", moveCount, forkCount);
+  print("  analyzeProgram(): {:.2f} ms", seconds * 1e3);
+}
+
+// Generates functions that allocate one string they return and one they only
+// print.
+String generateAllocatingSource(size_t functionCount) {
+  String source;
+  for (size_t i = 0; i < functionCount; i++) {
+    source += std::format(
+        "pub fn make{}(): string {{\n"
+        "  kept := \"kept\"\n"
+        "  local := \"local\"\n"
+        "  println(fork(local))\n"
+        "  return kept\n"
+        "}}\n\n",
+        i);
+  }
+  return source;
+}
+
+void benchmarkEscapes() {
+  String source = generateAllocatingSource(20000);
+  Optional<Program> parsed = parseAndAnalyze(source);
+  if (!parsed.has_value()) {
+    return;
+  }
+  Program& program = parsed.value();
+  print("escapes ({} functions)", program.functions.size());
+
+  size_t promotedCount = 0;
+  size_t allocationCount = 0;
+  double seconds = measureSeconds([&]() {
+    EscapeAnalyzer escapeAnalyzer;
+    escapeAnalyzer.analyzeProgram(program);
+    promotedCount = escapeAnalyzer.promotedCount;
+    allocationCount = escapeAnalyzer.allocations.size();
+  });
+  print("  {} of {} allocations promoted to the stack", promotedCount,
+        allocationCount);
+  print("  analyzeProgram(): {:.2f} ms", seconds * 1e3);
+}
+
+// Generates functions that call one-line accessors and wrappers.
+String generateWrapperSource(size_t functionCount) {
+  String source;
+  for (size_t i = 0; i < functionCount; i++) {
+    source += std::format(
+        "fn offset{0}(x: int): int {{\n"
+        "  return x + {0}\n"
+        "}}\n\n"
+        "pub fn use{0}(a: int, b: int): int {{\n"
+        "  return offset{0}(a) - offset{0}(b + 1)\n"
+        "}}\n\n",
+        i);
+  }
+  return source;
+}
+
+void benchmarkInliner() {
+  String source = generateWrapperSource(20000);
+  Optional<Program> parsed = parseAndAnalyze(source);
+  if (!parsed.has_value()) {
+    return;
+  }
+  Program& program = parsed.value();
+  print("inliner ({} functions)", program.functions.size());
+
+  Program inlined;
+  size_t inlinedCount = 0;
+  double seconds = measureSeconds([&]() {
+    inlined = program;
+    Inliner inliner;
+    inliner.inlineProgram(inlined);
+    inlinedCount = inliner.inlinedCount;
+  });
+  eliminateDeadFunctions(inlined);
+  print("  {} calls inlined, {} of {} functions left", inlinedCount,
+        inlined.functions.size(), program.functions.size());
+  print("  inlineProgram() and copying the program: {:.2f} ms",
+        seconds * 1e3);
+}
+
+void benchmarkMir() {
+  String source = generateSource(50000);
+  Optional<Program> parsed = parseAndAnalyze(source);
+  if (!parsed.has_value()) {
+    return;
+  }
+  Program& program = parsed.value();
+  print("mir ({} functions)", program.functions.size());
+
+  double compileSeconds = measureSeconds(
+      [&]() { keepAlive(Compiler().compileProgram(program).ok); });
+  MirProgram mir;
+  double buildSeconds = measureSeconds([&]() {
+    MirBuilder builder;
+    mir = builder.buildProgram(program).value;
+  });
+  MirPassManager passManager = createDefaultPassManager();
+  double passSeconds = measureSeconds([&]() {
+    MirProgram optimized = mir;
+    keepAlive(passManager.run(optimized).ok);
+  });
+  MirProgram optimized = mir;
+  Result<None> passResult = passManager.run(optimized);
+  if (!passResult.ok) {
+    print("  {}", passResult.getError());
+    return;
+  }
+  String output;
+  double emitSeconds = measureSeconds(
+      [&]() { output = MirCompiler().compileProgram(optimized); });
+  print("  Compiler::compileProgram(): {:.2f} ms", compileSeconds * 1e3);
+  print("  MirBuilder::buildProgram(): {:.2f} ms", buildSeconds * 1e3);
+  print("  default passes with verification, and copying the MIR: {:.2f} ms",
+        passSeconds * 1e3);
+  print("  MirCompiler::compileProgram(): {:.2f} ms, {} bytes",
+        emitSeconds * 1e3, output.size());
+}
+
+// Measures how fast each emitter writes its output.
+void benchmarkCodegen() {
+  String source = generateSource(50000);
+  Optional<Program> parsed = parseAndAnalyze(source);
+  if (!parsed.has_value()) {
+    return;
+  }
+  Program& program = parsed.value();
+  print("codegen ({} bytes of source)", source.size());
+
+  size_t compiledSize = 0;
+  double compileSeconds = measureSeconds([&]() {
+    compiledSize = Compiler().compileProgram(program).value.size();
+  });
+  printThroughput("Compiler::compileProgram()", compiledSize, compileSeconds);
+  size_t printedSize = 0;
+  double printSeconds = measureSeconds([&]() {
+    printedSize = AstPrinter().printProgram(program).value.size();
+  });
+  printThroughput("AstPrinter::printProgram()", printedSize, printSeconds);
+  print("  {} bytes of C, {} bytes of AST dump", compiledSize, printedSize);
+}
+
+// Compares compiling to a string and then writing it to a file with
+// streaming the output to the file as it's compiled.
+void benchmarkStreaming() {
+  String source = generateSource(100000);
+  Optional<Program> parsed = parseAndAnalyze(source);
+  if (!parsed.has_value()) {
+    return;
+  }
+  Program& program = parsed.value();
+  print("streaming ({} bytes of source)", source.size());
+
+  const char* fileName = "build/streamed.c";
+  size_t heldSize = 0;
+  double inMemorySeconds = measureSeconds([&]() {
+    Result<String> output = Compiler().compileProgram(program);
+    heldSize = output.value.capacity();
+    keepAlive(writeFile(fileName, output.value).ok);
+  });
+  Compiler compiler;
+  double streamingSeconds = measureSeconds([&]() {
+    Result<int> fd = createFile(fileName);
+    keepAlive(compiler.compileProgramToFile(program, fd.value).ok);
+    close(fd.value);
+  });
+  print("  compileProgram() and writeFile(): {:.2f} ms, {} bytes held",
+        inMemorySeconds * 1e3, heldSize);
+  print("  compileProgramToFile(): {:.2f} ms, {} bytes held",
+        streamingSeconds * 1e3, compiler.out.text.capacity());
+
+  // On a thread pool, only a window of functions about the size of the
+  // buffer is compiled at a time.
+  ThreadPool threadPool(4);
+  Compiler parallelCompiler = {.threadPool = &threadPool};
+  double parallelSeconds = measureSeconds([&]() {
+    Result<int> fd = createFile(fileName);
+    keepAlive(parallelCompiler.compileProgramToFile(program, fd.value).ok);
+    close(fd.value);
+  });
+  bool isSame = readFile(fileName).value ==
+                Compiler().compileProgram(program).value;
+  print("  compileProgramToFile() on 4 threads: {:.2f} ms{}",
+        parallelSeconds * 1e3, isSame ? "" : ", output differs!");
+}
+
+void benchmarkParallelCodegen() {
+  String source = generateSource(20000);
+  Optional<Program> parsed = parseAndAnalyze(source);
+  if (!parsed.has_value()) {
+    return;
+  }
+  Program& program = parsed.value();
+  print("parallel codegen ({} functions, {} hardware threads)",
+        program.functions.size(), std::thread::hardware_concurrency());
+
+  String serialOutput;
+  double serialSeconds = measureSeconds([&]() {
+    serialOutput = Compiler().compileProgram(program).value;
+  });
+  printThroughput("serial", serialOutput.size(), serialSeconds);
+  for (size_t workerCount : {1, 2, 4, 8, 16}) {
+    ThreadPool threadPool(workerCount);
+    String output;
+    double seconds = measureSeconds([&]() {
+      Compiler compiler = {.threadPool = &threadPool};
+      output = compiler.compileProgram(program).value;
+    });
+    printThroughput(std::format("{} threads", workerCount), output.size(),
+                    seconds);
+    if (output != serialOutput) {
+      print("  Output with {} threads differs from the serial output!",
+            workerCount);
+    }
+  }
+}
+
+// Splitting output into translation units should cost about as much as
+// compiling it into one file, with units of about the same size so they take
+// about as long for the C compiler.
+void benchmarkSplitCodegen() {
+  String source = generateSource(20000);
+  Optional<Program> parsed = parseAndAnalyze(source);
+  if (!parsed.has_value()) {
+    return;
+  }
+  Program& program = parsed.value();
+  print("split codegen ({} functions)", program.functions.size());
+
+  size_t outputSize = 0;
+  double singleSeconds = measureSeconds([&]() {
+    outputSize = Compiler().compileProgram(program).value.size();
+  });
+  printThroughput("single file", outputSize, singleSeconds);
+  for (size_t unitCount : {1, 4, 16}) {
+    Vector<OutputFile> files;
+    double seconds = measureSeconds([&]() {
+      SplitCompiler compiler = {.baseName = "program", .unitCount = unitCount};
+      files = compiler.compileProgram(program).value;
+    });
+    size_t totalSize = 0;
+    size_t smallestUnit = SIZE_MAX;
+    size_t largestUnit = 0;
+    // Skip the header and the manifest.
+    for (size_t i = 1; i + 1 < files.size(); i++) {
+      totalSize += files[i].text.size();
+      smallestUnit = std::min(smallestUnit, files[i].text.size());
+      largestUnit = std::max(largestUnit, files[i].text.size());
+    }
+    printThroughput(std::format("{} units", unitCount), totalSize, seconds);
+    print("    header {} bytes, units {} to {} bytes", files[0].text.size(),
+          smallestUnit, largestUnit);
+  }
+}
+
+void benchmarkAst() {
+  String source = generateSource(10000);
+  Parser parser(source);
+  Result<Program> program = parser.parse();
+  const Ast& ast = program.value.ast;
+  print("ast ({} functions)", program.value.functions.size());
+  print("  {} nodes, {} bytes used, {} bytes reserved", ast.getNodeCount(),
+        ast.getBytesUsed(), ast.getBytesReserved());
+
+  AstPrinter printer;
+  double seconds = measureSeconds([&]() {
+    Result<String> output = printer.printProgram(program.value);
+    keepAlive(output.value.size());
+  });
+  print("  printProgram(): {:.2f} ms", seconds * 1e3);
+}
+
+// Like measureSeconds(), but times each run from the start of prepare() to the
+// shell command printing its first line. Returns a negative number if the
+// command printed nothing.
+template <typename Function>
+double measureSecondsToFirstLine(Function prepare, const char* command) {
+  using Clock = std::chrono::steady_clock;
+  const auto minimumDuration = std::chrono::milliseconds(500);
+  Clock::time_point start = Clock::now();
+  Clock::duration fastest = Clock::duration::max();
+  do {
+    Clock::time_point runStart = Clock::now();
+    prepare();
+    FILE* output = popen(command, "r");
+    if (output == nullptr) {
+      return -1;
+    }
+    char line[256];
+    bool hasLine = fgets(line, sizeof(line), output) != nullptr;
+    Clock::duration elapsed = Clock::now() - runStart;
+    // Closing the pipe stops the command at its next line.
+    pclose(output);
+    if (!hasLine) {
+      return -1;
+    }
+    fastest = std::min(fastest, elapsed);
+  } while (Clock::now() - start < minimumDuration);
+  return std::chrono::duration<double>(fastest).count();
+}
+
+// Compares the time from source to the first printed line when running a
+// program with nuo run against generating C, compiling it with cc and running
+// the binary. The generated program prints first, then calls every helper.
+void benchmarkVm() {
+  size_t functionCount = 2000;
+  String source = generateSource(functionCount);
+  source += "fn main(): int {\n  println(\"first output\")\n";
+  for (size_t i = 0; i < functionCount; i++) {
+    source += std::format("  generated_helper_function_{}({}, 0.5)\n", i, i);
+  }
+  source += "  return 0\n}\n";
+  print("vm ({} functions)", functionCount + 1);
+  if (access("build/nuo", X_OK) != 0) {
+    print("  Build build/nuo first to run the program with it.");
+    return;
+  }
+  if (!parseAndAnalyze(source).has_value()) {
+    return;
+  }
+  if (!writeFile("build/vm_bench.nuo", source).ok) {
+    print("  Couldn't write build/vm_bench.nuo.");
+    return;
+  }
+
+  double vmSeconds = measureSecondsToFirstLine(
+      []() {}, "./build/nuo run build/vm_bench.nuo");
+  // The generated C calls println, which has no definition yet, so it's
+  // defined as puts when compiling.
+  double cSeconds = measureSecondsToFirstLine(
+      [&]() {
+        Optional<Program> program = parseAndAnalyze(source);
+        eliminateDeadFunctions(program.value());
+        Result<int> fd = createFile("build/vm_bench.c");
+        keepAlive(
+            Compiler().compileProgramToFile(program.value(), fd.value).ok);
+        close(fd.value);
+      },
+      "cc -w -O0 -Dprintln=puts build/vm_bench.c -o build/vm_bench && "
+      "./build/vm_bench");
+  if (vmSeconds < 0) {
+    print("  nuo run printed nothing.");
+  } else {
+    print("  nuo run: first line after {:.2f} ms", vmSeconds * 1e3);
+  }
+  if (cSeconds < 0) {
+    print("  Couldn't compile or run the generated C with cc.");
+  } else {
+    print("  generate C, compile it with cc -O0 and run it: first line after "
+          "{:.2f} ms",
+          cSeconds * 1e3);
+  }
+}
+
+struct Benchmark {
+  StringView name;
+  void (*run)();
+};
+
+int main(int argc, char** argv) {
+  Vector<Benchmark> benchmarks = {
+      Benchmark{.name = "tokenizer", .run = benchmarkTokenizer},
+      Benchmark{.name = "parallel_tokenizer",
+                .run = benchmarkParallelTokenizer},
+      Benchmark{.name = "keywords", .run = benchmarkKeywords},
+      Benchmark{.name = "parser", .run = benchmarkParser},
+      Benchmark{.name = "results", .run = benchmarkResults},
+      Benchmark{.name = "analyzer", .run = benchmarkAnalyzer},
+      Benchmark{.name = "parallel_analyzer", .run = benchmarkParallelAnalyzer},
+      Benchmark{.name = "dead_functions", .run = benchmarkDeadFunctions},
+      Benchmark{.name = "refcounts", .run = benchmarkRefcounts},
+      Benchmark{.name = "escapes", .run = benchmarkEscapes},
+      Benchmark{.name = "inliner", .run = benchmarkInliner},
+      Benchmark{.name = "mir", .run = benchmarkMir},
+      Benchmark{.name = "codegen", .run = benchmarkCodegen},
+      Benchmark{.name = "streaming", .run = benchmarkStreaming},
+      Benchmark{.name = "parallel_codegen", .run = benchmarkParallelCodegen},
+      Benchmark{.name = "split_codegen", .run = benchmarkSplitCodegen},
+      Benchmark{.name = "vm", .run = benchmarkVm},
+      Benchmark{.name = "ast", .run = benchmarkAst},
+      Benchmark{.name = "expressions", .run = benchmarkExpressions},
+  };
+
+  StringView filter = argc > 1 ? argv[1] : "";
+  for (const auto& benchmark : benchmarks) {
+    if (filter.empty() || benchmark.name == filter) {
+      DiagnosticsScope diagnosticsScope;
+      benchmark.run();
+    }
+  }
+}
+
+#endif  // BENCH_CC
@@ -1,12 +1,19 @@
 #ifndef BUILTINS_CC
 #define BUILTINS_CC
 
+#include <algorithm>
+#include <array>
 #include <format>
 #include <fstream>
 #include <iostream>
+#include <mutex>
 #include <optional>
+#include <span>
 #include <sstream>
 #include <string>
+#include <tuple>
+#include <type_traits>
+#include <variant>
 #include <vector>
 
 // Simplified types.
@@ -23,6 +30,8 @@ template <typename T>
 using Unique = std::unique_ptr<T>;
 template <class... _Types>
 using Variant = std::variant<_Types...>;
+template <typename T>
+using Span = std::span<T>;
 
 // Convenience print function.
 template <typename T>
@@ -36,16 +45,255 @@ void print(std::format_string<Args...> fmt, Args&&... args) {
             << std::endl;
 };
 
+// Set that keeps its items in the order they were first added. Lookups are
+// linear, so it's meant for the handful of program-wide facts like includes.
+template <typename T>
+struct OrderedSet {
+  Vector<T> items;
+
+  // Adds the item unless it's already in the set, returning whether it was.
+  bool add(T item) {
+    if (this->contains(item)) {
+      return false;
+    }
+    this->items.push_back(std::move(item));
+    return true;
+  }
+
+  bool contains(const T& item) const {
+    return std::find(this->items.begin(), this->items.end(), item) !=
+           this->items.end();
+  }
+
+  size_t size() const { return this->items.size(); }
+  const T& operator[](size_t index) const { return this->items[index]; }
+  auto begin() const { return this->items.begin(); }
+  auto end() const { return this->items.end(); }
+  void clear() { this->items.clear(); }
+};
+
 // Helper macros to generate enums and their string names.
 #define ENUM_GENERATOR(ENUM) ENUM,
 #define STRING_GENERATOR(STRING) #STRING,
 
-// Result type to gracefully handle errors.
+// Line and column of a position in the code, used when printing error
+// messages. Kept compact so that it can be stored with every AST node.
+struct Location {
+  int line;
+  int col;
+};
+
+// Formats a location as line:col.
+template <>
+struct std::formatter<Location> {
+  constexpr auto parse(std::format_parse_context& context) {
+    return context.begin();
+  }
+
+  auto format(const Location& loc, std::format_context& context) const {
+    return std::format_to(context.out(), "{}:{}", loc.line, loc.col);
+  }
+};
+
+// Handle to an error in the diagnostics store.
+struct ErrorId {
+  uint32_t index;
+};
+
+// Argument of a diagnostic, kept by value until its message is needed.
+// Strings and views are copied, since the code they point into may be gone by
+// the time the message is formatted.
+using DiagnosticArg =
+    Variant<int64_t, uint64_t, double, char, String, Location>;
+
+template <typename T>
+DiagnosticArg toDiagnosticArg(T&& arg) {
+  using Arg = std::decay_t<T>;
+  if constexpr (std::is_convertible_v<Arg, StringView>) {
+    return String(StringView(arg));
+  } else if constexpr (std::is_same_v<Arg, char> ||
+                       std::is_same_v<Arg, Location>) {
+    return arg;
+  } else if constexpr (std::is_floating_point_v<Arg>) {
+    return (double)arg;
+  } else if constexpr (std::is_signed_v<Arg>) {
+    return (int64_t)arg;
+  } else {
+    return (uint64_t)arg;
+  }
+}
+
+// Formats the argument with the spec of its replacement field, like .2f,
+// which was checked against the argument's own type along with the rest of
+// the format string.
+template <>
+struct std::formatter<DiagnosticArg> {
+  StringView spec;
+
+  constexpr auto parse(std::format_parse_context& context) {
+    auto end = std::find(context.begin(), context.end(), '}');
+    this->spec = StringView(context.begin(), end);
+    return end;
+  }
+
+  auto format(const DiagnosticArg& arg, std::format_context& context) const {
+    String format = "{:" + String(this->spec) + "}";
+    return std::visit(
+        [&](const auto& value) {
+          return std::vformat_to(context.out(), format,
+                                 std::make_format_args(value));
+        },
+        arg);
+  }
+};
+
+// Most arguments a diagnostic can have.
+const size_t MAX_DIAGNOSTIC_ARGS = 6;
+
+struct Diagnostic {
+  // Format string of the message, which also identifies the kind of error.
+  StringView format;
+  // Where in the code the error is, if it's about a place in the code.
+  Optional<Location> location;
+  std::array<DiagnosticArg, MAX_DIAGNOSTIC_ARGS> args;
+};
+
+// Errors of a compilation. Errors are only formatted when their message is
+// asked for, since many are never shown, like those that make the parallel
+// tokenizer fall back to tokenizing serially. A compilation's tokenizer
+// chunks and analyzer threads add errors at once, so adding takes a lock,
+// but every compilation has a store of its own.
+struct Diagnostics {
+  std::mutex mutex;
+  Vector<Diagnostic> entries;
+
+  template <typename... Args>
+  ErrorId add(std::format_string<Args...> fmt, Args&&... args) {
+    static_assert(sizeof...(Args) <= MAX_DIAGNOSTIC_ARGS,
+                  "Diagnostic has too many arguments.");
+    Diagnostic diagnostic = {
+        .format = fmt.get(),
+        .args = {toDiagnosticArg(std::forward<Args>(args))...}};
+    for (const auto& arg : diagnostic.args) {
+      if (std::holds_alternative<Location>(arg)) {
+        diagnostic.location = std::get<Location>(arg);
+      }
+    }
+    std::lock_guard<std::mutex> lock(this->mutex);
+    this->entries.push_back(std::move(diagnostic));
+    return ErrorId{.index = (uint32_t)(this->entries.size() - 1)};
+  }
+
+  String getMessage(ErrorId error) {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    const Diagnostic& diagnostic = this->entries[error.index];
+    return std::apply(
+        [&](const auto&... args) {
+          return std::vformat(diagnostic.format,
+                              std::make_format_args(args...));
+        },
+        diagnostic.args);
+  }
+
+  Optional<Location> getLocation(ErrorId error) {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    return this->entries[error.index].location;
+  }
+};
+
+// Store the errors of the compilation running on this thread go to.
+thread_local Diagnostics* currentDiagnostics = nullptr;
+
+Diagnostics& getDiagnostics() { return *currentDiagnostics; }
+
+// Owns the diagnostics of a compilation, which errors on this thread go to
+// until it ends. The ErrorIds of the compilation are only valid until then.
+// Scopes can be nested, like a test case's in the test runner's.
+struct DiagnosticsScope {
+  Diagnostics diagnostics;
+  Diagnostics* previous;
+
+  DiagnosticsScope() : previous(currentDiagnostics) {
+    currentDiagnostics = &this->diagnostics;
+  }
+  DiagnosticsScope(const DiagnosticsScope&) = delete;
+  DiagnosticsScope& operator=(const DiagnosticsScope&) = delete;
+  ~DiagnosticsScope() { currentDiagnostics = this->previous; }
+};
+
+// Result type to gracefully handle errors. Holds either the value or a handle
+// to the error, so a successful Result costs no more than its value, and a
+// Result of a trivially copyable value is trivially copyable itself.
 template <typename T>
 struct [[nodiscard]] Result {
   bool ok;
-  T value;
-  String error;
+  union {
+    T value;
+    ErrorId error;
+  };
+
+  Result(T value) : ok(true), value(std::move(value)) {}
+  Result(ErrorId error) : ok(false), error(error) {}
+
+  Result(const Result& other)
+    requires std::is_trivially_copy_constructible_v<T>
+  = default;
+  Result(const Result& other) : ok(other.ok) {
+    if (this->ok) {
+      new (&this->value) T(other.value);
+    } else {
+      this->error = other.error;
+    }
+  }
+
+  Result(Result&& other)
+    requires std::is_trivially_move_constructible_v<T>
+  = default;
+  Result(Result&& other) : ok(other.ok) {
+    if (this->ok) {
+      new (&this->value) T(std::move(other.value));
+    } else {
+      this->error = other.error;
+    }
+  }
+
+  Result& operator=(const Result& other)
+    requires std::is_trivially_copy_assignable_v<T> &&
+             std::is_trivially_destructible_v<T>
+  = default;
+  Result& operator=(const Result& other) {
+    if (this != &other) {
+      this->~Result();
+      new (this) Result(other);
+    }
+    return *this;
+  }
+
+  Result& operator=(Result&& other)
+    requires std::is_trivially_move_assignable_v<T> &&
+             std::is_trivially_destructible_v<T>
+  = default;
+  Result& operator=(Result&& other) {
+    if (this != &other) {
+      this->~Result();
+      new (this) Result(std::move(other));
+    }
+    return *this;
+  }
+
+  ~Result()
+    requires std::is_trivially_destructible_v<T>
+  = default;
+  ~Result() {
+    if (this->ok) {
+      this->value.~T();
+    }
+  }
+
+  // Formats the error message. Only valid if the Result isn't ok.
+  String getError() const {
+    return getDiagnostics().getMessage(this->error);
+  }
 };
 
 // Represents a "void" type when returning a Result from a function without a
@@ -55,11 +303,15 @@ struct None {};
 // Creates an Ok result with the given value.
 template <typename T>
 Result<T> Ok(T value) {
-  return Result<T>{.ok = true, .value = std::move(value)};
+  return Result<T>(std::move(value));
 };
 
 // Creates an Ok result for void functions.
-Result<None> Ok() { return Result<None>{.ok = true, .value = None{}}; };
+Result<None> Ok() { return Result<None>(None{}); };
+
+static_assert(std::is_trivially_copyable_v<Result<None>> &&
+                  sizeof(Result<None>) == 8,
+              "Result<None> should be passed around in a register.");
 
 // Helper struct that helps us automatically deduce the template T param when
 // returning an error result. C++ normally doesn't use return type to help
@@ -69,25 +321,27 @@ Result<None> Ok() { return Result<None>{.ok = true, .value = None{}}; };
 // before calling the conversion operator which then creates a Result<T> with
 // the appropriate type!
 struct DeduceReturnForErrorResult {
-  String error;
+  ErrorId error;
 
   template <typename T>
   operator Result<T>() {
-    return Result<T>{.ok = false, .error = error};
+    return Result<T>(this->error);
   }
 };
 
-// Creates an Error result with the given string.
-DeduceReturnForErrorResult Error(String error) {
+// Creates an Error result for an error that's already in the diagnostics
+// store, usually to pass it on.
+DeduceReturnForErrorResult Error(ErrorId error) {
   return DeduceReturnForErrorResult{.error = error};
 };
 
-// Creates an Error result with the given format string and arguments.
+// Creates an Error result with the given format string and arguments, which
+// are only formatted once the message is needed.
 template <typename... Args>
 DeduceReturnForErrorResult Error(std::format_string<Args...> fmt,
                                  Args&&... args) {
   return DeduceReturnForErrorResult{
-      .error = std::vformat(fmt.get(), std::make_format_args(args...))};
+      .error = getDiagnostics().add(fmt, std::forward<Args>(args)...)};
 };
 
 // Helper macros for concatenating macro values.
@@ -98,7 +352,7 @@ DeduceReturnForErrorResult Error(std::format_string<Args...> fmt,
 #define TRY_ASSIGN_IMPL(resultVar, dest, expr) \
   auto resultVar = (expr);                     \
   if (!resultVar.ok) [[unlikely]] {            \
-    return Error(std::move(resultVar.error));  \
+    return Error(resultVar.error);             \
   }                                            \
   dest = std::move(resultVar.value);
 
@@ -115,7 +369,7 @@ DeduceReturnForErrorResult Error(std::format_string<Args...> fmt,
   static_assert(std::is_same<decltype(result_var), Result<None>>::value, \
                 "Single argument to TRY must be of Result<None> type."); \
   if (!result_var.ok) [[unlikely]] {                                     \
-    return Error(std::move(result_var.error));                           \
+    return Error(result_var.error);                                      \
   }
 
 // Returns an error Result if the called expression returned an error Result.
@@ -0,0 +1,126 @@
+#ifndef BYTECODE_CC
+#define BYTECODE_CC
+
+#include "ast.cc"
+#include "builtins.cc"
+
+// Register-based bytecode run by the Vm, which runs programs without a C
+// toolchain. Each function has a fixed number of registers, numbered from 0
+// with the parameters first, and every instruction names the registers it
+// reads and writes, so values never move through an operand stack.
+
+// Value of a register. Its type is known from the instruction using it, since
+// the program was type checked before being lowered.
+union Value {
+  int64_t intValue;
+  double floatValue;
+  // String in BytecodeProgram::strings.
+  const StringView* stringValue;
+};
+
+// Opcodes, where a, b and c are the registers an instruction names:
+//
+// LOAD_CONSTANT   a = BytecodeFunction::constants[immediate]
+// LOAD_STRING     a = BytecodeProgram::strings[immediate]
+// EQUAL_INT...    a = b op c, with an opcode per operator and operand type,
+//                 in the order of BinaryOperator so the opcode is found by
+//                 adding the operator to the first one
+// CALL            a = call of BytecodeFunction::calls[immediate], unless the
+//                 function returns nothing
+// PRINTLN         prints the string in a followed by a newline
+// RETURN          returns a
+// RETURN_VOID     returns nothing
+#define FOREACH_BYTECODE_OPCODE(GENERATOR) \
+  GENERATOR(LOAD_CONSTANT)                 \
+  GENERATOR(LOAD_STRING)                   \
+  GENERATOR(EQUAL_INT)                     \
+  GENERATOR(NOT_EQUAL_INT)                 \
+  GENERATOR(LESS_INT)                      \
+  GENERATOR(LESS_EQUAL_INT)                \
+  GENERATOR(GREATER_INT)                   \
+  GENERATOR(GREATER_EQUAL_INT)             \
+  GENERATOR(ADD_INT)                       \
+  GENERATOR(SUBTRACT_INT)                  \
+  GENERATOR(EQUAL_FLOAT)                   \
+  GENERATOR(NOT_EQUAL_FLOAT)               \
+  GENERATOR(LESS_FLOAT)                    \
+  GENERATOR(LESS_EQUAL_FLOAT)              \
+  GENERATOR(GREATER_FLOAT)                 \
+  GENERATOR(GREATER_EQUAL_FLOAT)           \
+  GENERATOR(ADD_FLOAT)                     \
+  GENERATOR(SUBTRACT_FLOAT)                \
+  GENERATOR(CALL)                          \
+  GENERATOR(PRINTLN)                       \
+  GENERATOR(RETURN)                        \
+  GENERATOR(RETURN_VOID)
+enum class BytecodeOpcode : uint8_t {
+  FOREACH_BYTECODE_OPCODE(ENUM_GENERATOR)
+};
+static const char* bytecodeOpcodeString[] = {
+    FOREACH_BYTECODE_OPCODE(STRING_GENERATOR)};
+String bytecodeOpcodeToString(BytecodeOpcode opcode) {
+  return bytecodeOpcodeString[static_cast<int>(opcode)];
+}
+
+static_assert((int)BytecodeOpcode::SUBTRACT_INT -
+                      (int)BytecodeOpcode::EQUAL_INT ==
+                  (int)BinaryOperator::SUBTRACT,
+              "Integer opcodes must be in the order of BinaryOperator.");
+static_assert((int)BytecodeOpcode::EQUAL_FLOAT -
+                      (int)BytecodeOpcode::EQUAL_INT ==
+                  (int)BinaryOperator::SUBTRACT + 1,
+              "Float opcodes must follow the integer ones.");
+
+// Most registers a function can have. Instructions name them in 16 bits, with
+// the largest number left for values without a register.
+const size_t MAX_REGISTER_COUNT = UINT16_MAX;
+
+// Instruction of 8 bytes, so a cache line holds 8 of them. Opcodes needing a
+// 32-bit index store it in b and c.
+struct BytecodeInstruction {
+  BytecodeOpcode opcode;
+  uint16_t a = 0;
+  uint16_t b = 0;
+  uint16_t c = 0;
+
+  static BytecodeInstruction withImmediate(BytecodeOpcode opcode, uint16_t a,
+                                           uint32_t immediate) {
+    return BytecodeInstruction{.opcode = opcode,
+                               .a = a,
+                               .b = (uint16_t)immediate,
+                               .c = (uint16_t)(immediate >> 16)};
+  }
+
+  uint32_t getImmediate() const { return this->b | (uint32_t)this->c << 16; }
+};
+static_assert(sizeof(BytecodeInstruction) == 8);
+
+// Call to a function of the program.
+struct BytecodeCall {
+  // Index in BytecodeProgram::functions.
+  uint32_t function;
+  // Start of the registers passed as arguments in BytecodeFunction::arguments,
+  // one per parameter of the function.
+  uint32_t argumentStart;
+};
+
+struct BytecodeFunction {
+  Symbol name;
+  BaseType returnType;
+  uint32_t paramCount = 0;
+  uint32_t registerCount = 0;
+  Vector<BytecodeInstruction> instructions;
+  Vector<Value> constants;
+  Vector<BytecodeCall> calls;
+  Vector<uint16_t> arguments;
+};
+
+struct BytecodeProgram {
+  Vector<BytecodeFunction> functions;
+  // Index of main in functions.
+  uint32_t mainFunction = 0;
+  // Contents of the string literals, without the quotes.
+  Vector<StringView> strings;
+};
+
+#endif  // BYTECODE_CC
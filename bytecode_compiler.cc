@@ -0,0 +1,173 @@
+#ifndef BYTECODE_COMPILER_CC
+#define BYTECODE_COMPILER_CC
+
+#include "builtins.cc"
+#include "bytecode.cc"
+#include "mir.cc"
+#include "scoped_symbol_map.cc"
+
+// Register of MIR values that don't need one.
+const uint16_t NO_REGISTER = MAX_REGISTER_COUNT;
+
+// Lowers MIR to bytecode for the Vm. Every value computed by an instruction
+// gets a register of its own, while a fork reuses the register of the value
+// it forks, since values are plain values until heap types are run.
+struct BytecodeCompiler {
+  // Index of every function of the program.
+  ScopedSymbolMap<uint32_t> functionIndexes;
+  BytecodeProgram* program;
+  const MirFunction* mirFunction;
+  BytecodeFunction* function;
+  // Register of each value of the function being compiled.
+  Vector<uint16_t> registers;
+
+  Result<BytecodeProgram> compileProgram(const MirProgram& mir) {
+    BytecodeProgram program;
+    this->program = &program;
+    for (uint32_t i = 0; i < mir.functions.size(); i++) {
+      this->functionIndexes.set(mir.functions[i].name, i);
+    }
+    const uint32_t* mainFunction = this->functionIndexes.get(Symbol::MAIN);
+    if (mainFunction == nullptr) {
+      return Error("The program has no main function to run.");
+    }
+    program.mainFunction = *mainFunction;
+    program.functions.resize(mir.functions.size());
+    for (size_t i = 0; i < mir.functions.size(); i++) {
+      TRY(this->compileFunction(mir.functions[i], program.functions[i]));
+    }
+    return Ok(std::move(program));
+  }
+
+  Result<None> compileFunction(const MirFunction& mirFunction,
+                               BytecodeFunction& function) {
+    this->mirFunction = &mirFunction;
+    this->function = &function;
+    function.name = mirFunction.name;
+    function.returnType = mirFunction.returnType;
+    function.paramCount = mirFunction.paramCount;
+    TRY(this->assignRegisters());
+    for (const auto& block : mirFunction.blocks) {
+      for (MirValue value = block.instructionStart;
+           value < block.instructionStart + block.instructionCount; value++) {
+        TRY(this->compileInstruction(value));
+      }
+      if (block.returnValue == NO_VALUE) {
+        this->emit(BytecodeInstruction{.opcode = BytecodeOpcode::RETURN_VOID});
+      } else {
+        this->emit(BytecodeInstruction{
+            .opcode = BytecodeOpcode::RETURN,
+            .a = this->registers[block.returnValue]});
+      }
+    }
+    return Ok();
+  }
+
+  // Numbers the registers in the order of the values, so the parameters,
+  // which come first, are in the registers the Vm passes arguments in.
+  Result<None> assignRegisters() {
+    const MirFunction& function = *this->mirFunction;
+    this->registers.assign(function.instructions.size(), NO_REGISTER);
+    uint32_t registerCount = 0;
+    for (MirValue value = 0; value < function.instructions.size(); value++) {
+      const MirInstruction& instruction = function.instructions[value];
+      if (instruction.opcode == MirOpcode::FORK) {
+        this->registers[value] =
+            this->registers[function.getOperands(instruction)[0]];
+      } else if (instruction.type != BaseType::VOID) {
+        if (registerCount == MAX_REGISTER_COUNT) {
+          return Error("Function {} needs more than {} registers.",
+                       symbolTable.getName(function.name), MAX_REGISTER_COUNT);
+        }
+        this->registers[value] = registerCount++;
+      }
+    }
+    this->function->registerCount = registerCount;
+    return Ok();
+  }
+
+  Result<None> compileInstruction(MirValue value) {
+    const MirInstruction& instruction = this->mirFunction->instructions[value];
+    Span<const MirValue> operands =
+        this->mirFunction->getOperands(instruction);
+    uint16_t result = this->registers[value];
+    switch (instruction.opcode) {
+      case MirOpcode::PARAM:
+      case MirOpcode::FORK:
+        return Ok();
+      case MirOpcode::NUMBER: {
+        const Constant& constant =
+            this->mirFunction->constants[instruction.immediate];
+        Value constantValue;
+        if (constant.type == BaseType::INT) {
+          constantValue.intValue = constant.intValue;
+        } else {
+          constantValue.floatValue = constant.floatValue;
+        }
+        this->function->constants.push_back(constantValue);
+        this->emit(BytecodeInstruction::withImmediate(
+            BytecodeOpcode::LOAD_CONSTANT, result,
+            this->function->constants.size() - 1));
+        return Ok();
+      }
+      case MirOpcode::STRING: {
+        // Strip the quotes.
+        StringView literal = this->mirFunction->strings[instruction.immediate];
+        this->program->strings.push_back(
+            literal.substr(1, literal.size() - 2));
+        this->emit(BytecodeInstruction::withImmediate(
+            BytecodeOpcode::LOAD_STRING, result,
+            this->program->strings.size() - 1));
+        return Ok();
+      }
+      case MirOpcode::BINARY: {
+        // Comparisons result in an INT, so the opcode goes by the operands.
+        BaseType type = this->mirFunction->instructions[operands[0]].type;
+        BytecodeOpcode first = type == BaseType::FLOAT
+                                   ? BytecodeOpcode::EQUAL_FLOAT
+                                   : BytecodeOpcode::EQUAL_INT;
+        this->emit(BytecodeInstruction{
+            .opcode = (BytecodeOpcode)((int)first + (int)instruction.op),
+            .a = result,
+            .b = this->registers[operands[0]],
+            .c = this->registers[operands[1]]});
+        return Ok();
+      }
+      case MirOpcode::CALL:
+        return this->compileCall(instruction, operands, result);
+    }
+    return Ok();
+  }
+
+  Result<None> compileCall(const MirInstruction& instruction,
+                           Span<const MirValue> operands, uint16_t result) {
+    if (instruction.name == Symbol::PRINTLN) {
+      this->emit(BytecodeInstruction{.opcode = BytecodeOpcode::PRINTLN,
+                                     .a = this->registers[operands[0]]});
+      return Ok();
+    }
+    const uint32_t* callee = this->functionIndexes.get(instruction.name);
+    if (callee == nullptr) {
+      return Error("Function {} can't be run by the VM yet.",
+                   symbolTable.getName(instruction.name));
+    }
+    BytecodeFunction& function = *this->function;
+    function.calls.push_back(BytecodeCall{
+        .function = *callee,
+        .argumentStart = (uint32_t)function.arguments.size()});
+    for (MirValue operand : operands) {
+      function.arguments.push_back(this->registers[operand]);
+    }
+    // Calls returning nothing write no register.
+    this->emit(BytecodeInstruction::withImmediate(
+        BytecodeOpcode::CALL, result == NO_REGISTER ? 0 : result,
+        function.calls.size() - 1));
+    return Ok();
+  }
+
+  void emit(BytecodeInstruction instruction) {
+    this->function->instructions.push_back(instruction);
+  }
+};
+
+#endif  // BYTECODE_COMPILER_CC
@@ -0,0 +1,103 @@
+#ifndef CALL_GRAPH_CC
+#define CALL_GRAPH_CC
+
+#include "builtins.cc"
+
+// Call from one function of the program to another. Functions are identified
+// by their index in Program::functions.
+struct Call {
+  uint32_t caller;
+  uint32_t callee;
+};
+
+// Functions each function of the program calls directly. The callees of every
+// function are stored in one array ordered by caller, so a function's callees
+// are a contiguous, sorted and deduplicated span.
+struct CallGraph {
+  // Callees of function i are callees[calleeStarts[i]] up to
+  // callees[calleeStarts[i + 1]].
+  Vector<uint32_t> calleeStarts = {0};
+  Vector<uint32_t> callees;
+
+  // Builds the graph of functionCount functions from calls in any order,
+  // which may repeat.
+  static CallGraph build(size_t functionCount, Vector<Call> calls) {
+    std::sort(calls.begin(), calls.end(), [](const Call& a, const Call& b) {
+      return std::tie(a.caller, a.callee) < std::tie(b.caller, b.callee);
+    });
+    CallGraph graph;
+    graph.calleeStarts.resize(functionCount + 1);
+    size_t next = 0;
+    for (uint32_t caller = 0; caller < functionCount; caller++) {
+      graph.calleeStarts[caller] = graph.callees.size();
+      for (; next < calls.size() && calls[next].caller == caller; next++) {
+        if (graph.callees.size() == graph.calleeStarts[caller] ||
+            graph.callees.back() != calls[next].callee) {
+          graph.callees.push_back(calls[next].callee);
+        }
+      }
+    }
+    graph.calleeStarts[functionCount] = graph.callees.size();
+    return graph;
+  }
+
+  size_t getFunctionCount() const { return this->calleeStarts.size() - 1; }
+
+  Span<const uint32_t> getCallees(uint32_t function) const {
+    uint32_t start = this->calleeStarts[function];
+    return Span<const uint32_t>(this->callees.data() + start,
+                                this->calleeStarts[function + 1] - start);
+  }
+
+  // Returns which functions the roots call, directly or not, including the
+  // roots themselves.
+  Vector<bool> getReachable(Span<const uint32_t> roots) const {
+    Vector<bool> reachable(this->getFunctionCount());
+    Vector<uint32_t> stack;
+    for (uint32_t root : roots) {
+      if (!reachable[root]) {
+        reachable[root] = true;
+        stack.push_back(root);
+      }
+    }
+    while (!stack.empty()) {
+      uint32_t function = stack.back();
+      stack.pop_back();
+      for (uint32_t callee : this->getCallees(function)) {
+        if (!reachable[callee]) {
+          reachable[callee] = true;
+          stack.push_back(callee);
+        }
+      }
+    }
+    return reachable;
+  }
+
+  // Returns the graph of just the kept functions, which are renumbered in
+  // order. Calls to functions that aren't kept are dropped.
+  CallGraph filter(const Vector<bool>& keep) const {
+    Vector<uint32_t> newIndices(this->getFunctionCount());
+    uint32_t keptCount = 0;
+    for (size_t i = 0; i < keep.size(); i++) {
+      newIndices[i] = keptCount;
+      keptCount += keep[i];
+    }
+
+    CallGraph graph;
+    graph.calleeStarts.reserve(keptCount + 1);
+    for (uint32_t function = 0; function < keep.size(); function++) {
+      if (!keep[function]) {
+        continue;
+      }
+      for (uint32_t callee : this->getCallees(function)) {
+        if (keep[callee]) {
+          graph.callees.push_back(newIndices[callee]);
+        }
+      }
+      graph.calleeStarts.push_back(graph.callees.size());
+    }
+    return graph;
+  }
+};
+
+#endif  // CALL_GRAPH_CC
@@ -3,98 +3,222 @@
 
 #include "ast.cc"
 #include "builtins.cc"
+#include "output_buffer.cc"
+#include "thread_pool.cc"
 
 const size_t INDENT_SIZE = 2;
+// Chunks of functions per worker when compiling on a thread pool. More chunks
+// balance the work better, but each one is a buffer to copy from.
+const size_t CODEGEN_CHUNKS_PER_WORKER = 8;
+
+StringView getCTypeName(BaseType type) {
+  // Every base type has a C type, and -Wswitch flags any added without one.
+  switch (type) {
+    case BaseType::VOID:
+      return "void";
+    case BaseType::INT:
+      return "int";
+    case BaseType::FLOAT:
+      return "double";
+    case BaseType::STRING:
+      return "const char*";
+  }
+  __builtin_unreachable();
+}
 
 struct Compiler {
-  StringStream out;
+  OutputBuffer out;
   size_t indent = 0;
+  // Storage of the nodes of the program being compiled.
+  const Ast* ast;
+  // Pool to compile functions on, or null to compile them on the calling
+  // thread. The output is the same either way.
+  ThreadPool* threadPool = nullptr;
 
+  // Compiles the program to a string.
   Result<String> compileProgram(const Program& node) {
     // Empty the output buffer in case this was called before.
-    out.str("");
+    this->out = OutputBuffer();
+    this->out.reserve(node.sourceSize * OUTPUT_SIZE_PER_SOURCE_BYTE);
+    TRY(this->compileProgramToBuffer(node));
+    return Ok(this->out.take());
+  }
+
+  // Compiles the program straight to the file descriptor, which may be a
+  // pipe, holding no more than bufferSize bytes of output at a time, or about
+  // twice that when compiling on a thread pool. The descriptor is left open,
+  // and on error holds part of the output.
+  Result<None> compileProgramToFile(const Program& node, int fd,
+                                    size_t bufferSize = STREAM_BUFFER_SIZE) {
+    this->out = OutputBuffer::toFile(fd, bufferSize);
+    TRY(this->compileProgramToBuffer(node));
+    return this->out.finish();
+  }
+
+  Result<None> compileProgramToBuffer(const Program& node) {
+    this->ast = &node.ast;
 
     // Compile include headers.
     for (size_t i = 0; i < node.includes.size(); i++) {
-      this->out << "#include <" << node.includes[i] << ">\n";
+      this->out.write("#include <");
+      this->out.write(node.includes[i]);
+      this->out.write(">\n");
     }
     if (node.includes.size() > 0) {
-      this->out << "\n";
+      this->out.writeChar('\n');
     }
 
     // Compile functions.
-    for (size_t i = 0; i < node.functions.size(); i++) {
+    if (this->threadPool != nullptr && this->threadPool->getWorkerCount() > 1) {
+      return this->compileFunctionsInParallel(node);
+    }
+    return this->compileFunctions(node, 0, node.functions.size());
+  }
+
+  // Compiles the functions from start up to end, each followed by the
+  // separator if it isn't the last of the program.
+  Result<None> compileFunctions(const Program& node, size_t start,
+                                size_t end) {
+    for (size_t i = start; i < end; i++) {
       TRY(this->compileFunctionDeclaration(node.functions[i]));
       if (i < node.functions.size() - 1) {
-        this->out << "\n\n";
+        this->out.write("\n\n");
       }
     }
+    return Ok();
+  }
 
-    return Ok(out.str());
+  // Compiles the functions on the thread pool. When streaming to a file, the
+  // functions are compiled a window at a time, with each window's output
+  // expected to be about the size of the buffer. That way no more than about
+  // a buffer's worth of output is held at once, however large the program.
+  Result<None> compileFunctionsInParallel(const Program& node) {
+    size_t functionCount = node.functions.size();
+    size_t windowSize = functionCount;
+    if (this->out.fd >= 0 && functionCount > 0) {
+      size_t bytesPerFunction = std::max<size_t>(
+          node.sourceSize * OUTPUT_SIZE_PER_SOURCE_BYTE / functionCount, 1);
+      windowSize = std::max(
+          this->out.flushSize / bytesPerFunction,
+          this->threadPool->getWorkerCount() * CODEGEN_CHUNKS_PER_WORKER);
+    }
+    for (size_t start = 0; start < functionCount; start += windowSize) {
+      TRY(this->compileWindowInParallel(
+          node, start, std::min(start + windowSize, functionCount)));
+    }
+    return Ok();
   }
 
-  Result<None> compileFunctionDeclaration(const FunctionDeclaration& node) {
-    TRY(this->compileType(node.returnType));
-    this->out << " " << node.name;
-
-    this->out << "(";
-    for (size_t i = 0; i < node.params.size(); i++) {
-      TRY(this->compileType(node.params[i].type));
-      this->out << " " << node.params[i].name;
-      if (i < node.params.size() - 1) {
-        this->out << ", ";
+  // Compiles chunks of the consecutive functions from start up to end on the
+  // thread pool, each into a buffer of its own, then writes the chunks in
+  // order. Functions only read the program, so the output and the error
+  // reported, which is the first chunk's first, are the same as when
+  // compiling serially.
+  Result<None> compileWindowInParallel(const Program& node, size_t start,
+                                       size_t end) {
+    size_t functionCount = end - start;
+    size_t workerCount = this->threadPool->getWorkerCount();
+    size_t chunkCount =
+        std::min(functionCount, workerCount * CODEGEN_CHUNKS_PER_WORKER);
+    Vector<String> chunkOutputs(chunkCount);
+    Vector<Optional<ErrorId>> chunkErrors(chunkCount);
+    Vector<Compiler> compilers(workerCount, Compiler{.ast = this->ast});
+    size_t expectedSize = node.sourceSize * OUTPUT_SIZE_PER_SOURCE_BYTE *
+                          functionCount / node.functions.size();
+    this->threadPool->parallelFor(chunkCount, [&](size_t chunk,
+                                                  size_t worker) {
+      Compiler& compiler = compilers[worker];
+      compiler.out = OutputBuffer();
+      compiler.out.reserve(expectedSize / chunkCount);
+      Result<None> result = compiler.compileFunctions(
+          node, start + chunk * functionCount / chunkCount,
+          start + (chunk + 1) * functionCount / chunkCount);
+      if (!result.ok) {
+        chunkErrors[chunk] = result.error;
+      }
+      chunkOutputs[chunk] = compiler.out.take();
+    });
+
+    for (size_t chunk = 0; chunk < chunkCount; chunk++) {
+      if (chunkErrors[chunk].has_value()) {
+        return Error(chunkErrors[chunk].value());
       }
+      this->out.write(chunkOutputs[chunk]);
+      // Free each chunk once it's written.
+      chunkOutputs[chunk] = String();
     }
-    this->out << ") ";
+    return Ok();
+  }
 
+  Result<None> compileFunctionDeclaration(const FunctionDeclaration& node) {
+    TRY(this->compileFunctionSignature(node));
+    this->out.writeChar(' ');
     TRY(this->compileStatementBlock(node.body));
+    return Ok();
+  }
+
+  Result<None> compileFunctionSignature(const FunctionDeclaration& node) {
+    TRY(this->compileType(node.returnType));
+    this->out.writeChar(' ');
+    this->out.write(symbolTable.getName(node.name));
 
+    this->out.writeChar('(');
+    Span<const FunctionParameter> params = this->ast->get(node.params);
+    for (size_t i = 0; i < params.size(); i++) {
+      TRY(this->compileType(params[i].type));
+      this->out.writeChar(' ');
+      this->out.write(symbolTable.getName(params[i].name));
+      if (i < params.size() - 1) {
+        this->out.write(", ");
+      }
+    }
+    this->out.writeChar(')');
     return Ok();
   }
 
   Result<None> compileStatementBlock(const StatementBlock& node) {
-    this->out << "{\n";
+    this->out.write("{\n");
     this->indent += INDENT_SIZE;
-    for (const auto& statement : node.statements) {
-      for (size_t i = 0; i < this->indent; i++) {
-        this->out << " ";
-      }
+    for (const auto& statement : this->ast->get(node.statements)) {
+      this->out.writeIndent(this->indent);
       TRY(this->compileStatement(statement));
-      this->out << ";\n";
+      this->out.write(";\n");
     }
     this->indent -= INDENT_SIZE;
-    this->out << "}";
+    this->out.writeChar('}');
     return Ok();
   }
 
   Result<None> compileStatement(const Statement& node) {
-    if (std::holds_alternative<Unique<FunctionCall>>(node)) {
-      TRY(this->compileFunctionCall(*std::get<Unique<FunctionCall>>(node)));
-      return Ok();
-    }
-    if (std::holds_alternative<Unique<Return>>(node)) {
-      TRY(this->compileReturn(*std::get<Unique<Return>>(node)));
-      return Ok();
-    }
-    return Error("Unexpected Statement of index {} when compiling.",
-                 node.index());
+    return visit(*this->ast, node,
+                 Overloaded{[&](const VariableDeclaration& node) {
+                              return this->compileVariableDeclaration(node);
+                            },
+                            [&](const FunctionCall& node) {
+                              return this->compileFunctionCall(node);
+                            },
+                            [&](const Return& node) {
+                              return this->compileReturn(node);
+                            }});
   }
 
   Result<None> compileExpression(const Expression& node) {
-    if (std::holds_alternative<Unique<FunctionCall>>(node)) {
-      TRY(this->compileFunctionCall(*std::get<Unique<FunctionCall>>(node)));
-      return Ok();
-    }
-    if (std::holds_alternative<Unique<NumberLiteral>>(node)) {
-      TRY(this->compileNumberLiteral(*std::get<Unique<NumberLiteral>>(node)));
-      return Ok();
-    }
-    if (std::holds_alternative<Unique<StringLiteral>>(node)) {
-      TRY(this->compileStringLiteral(*std::get<Unique<StringLiteral>>(node)));
-      return Ok();
-    }
-    return Error("Unexpected Expression of index {} when compiling.",
-                 node.index());
+    return visit(*this->ast, node,
+                 Overloaded{[&](const VariableReference& node) {
+                              return this->compileVariableReference(node);
+                            },
+                            [&](const FunctionCall& node) {
+                              return this->compileFunctionCall(node);
+                            },
+                            [&](const NumberLiteral& node) {
+                              return this->compileNumberLiteral(node);
+                            },
+                            [&](const StringLiteral& node) {
+                              return this->compileStringLiteral(node);
+                            },
+                            [&](const BinaryExpression& node) {
+                              return this->compileBinaryExpression(node);
+                            }});
   }
 
   Result<None> compileType(const Type& type) {
@@ -110,50 +234,98 @@ struct Compiler {
   }
 
   Result<None> compileBaseType(const BaseType& type) {
-    if (type == BaseType::VOID) {
-      this->out << "void";
-      return Ok();
-    } else if (type == BaseType::INT) {
-      this->out << "int";
-      return Ok();
-    }
-    return Error("Unexpected BaseType {} when compiling.",
-                 baseTypeToString(type));
+    this->out.write(getCTypeName(type));
+    return Ok();
   }
 
   Result<None> compileListType(const ListType& listType) {
-    this->out << "[";
+    this->out.writeChar('[');
     TRY(this->compileBaseType(listType.elementType));
-    this->out << "]";
+    this->out.writeChar(']');
+    return Ok();
+  }
+
+  Result<None> compileVariableDeclaration(const VariableDeclaration& node) {
+    TRY(this->compileType(node.type));
+    this->out.writeChar(' ');
+    this->out.write(symbolTable.getName(node.name));
+    this->out.write(" = ");
+    TRY(this->compileExpression(node.expression));
     return Ok();
   }
 
   Result<None> compileFunctionCall(const FunctionCall& node) {
-    this->out << node.name << "(";
-    for (size_t i = 0; i < node.args.size(); i++) {
-      TRY(this->compileExpression(node.args[i]));
-      if (i < node.args.size() - 1) {
-        this->out << ", ";
+    // Values are plain C values until heap types are compiled, so a fork and
+    // the move it may have become both compile to the value itself.
+    if (node.name == Symbol::FORK) {
+      return this->compileExpression(this->ast->get(node.args)[0]);
+    }
+    this->out.write(symbolTable.getName(node.name));
+    this->out.writeChar('(');
+    Span<const Expression> args = this->ast->get(node.args);
+    for (size_t i = 0; i < args.size(); i++) {
+      TRY(this->compileExpression(args[i]));
+      if (i < args.size() - 1) {
+        this->out.write(", ");
       }
     }
-    this->out << ")";
+    this->out.writeChar(')');
+    return Ok();
+  }
+
+  Result<None> compileVariableReference(const VariableReference& node) {
+    this->out.write(symbolTable.getName(node.name));
     return Ok();
   }
 
   Result<None> compileNumberLiteral(const NumberLiteral& node) {
-    this->out << node.value;
+    if (node.value.empty()) {
+      this->out.write(node.constant.toString());
+    } else {
+      this->out.write(node.value);
+    }
     return Ok();
   }
 
   Result<None> compileStringLiteral(const StringLiteral& node) {
-    this->out << node.value;
+    this->out.write(node.value);
+    return Ok();
+  }
+
+  Result<None> compileBinaryExpression(const BinaryExpression& node) {
+    int precedence = getPrecedence(node.op);
+    // Operators are left associative, so an operand on the right needs
+    // parentheses even when its operator binds equally tight.
+    TRY(this->compileOperand(node.left, precedence));
+    this->out.writeChar(' ');
+    this->out.write(binaryOperatorToString(node.op));
+    this->out.writeChar(' ');
+    TRY(this->compileOperand(node.right, precedence + 1));
+    return Ok();
+  }
+
+  // Compiles an operand of a binary expression, wrapping it in parentheses if
+  // it's a binary expression whose operator binds less tightly than the given
+  // precedence.
+  Result<None> compileOperand(const Expression& node, int minPrecedence) {
+    bool needsParentheses =
+        node.is<BinaryExpression>() &&
+        getPrecedence(this->ast->get<BinaryExpression>(node).op) <
+            minPrecedence;
+    if (needsParentheses) {
+      this->out.writeChar('(');
+    }
+    TRY(this->compileExpression(node));
+    if (needsParentheses) {
+      this->out.writeChar(')');
+    }
     return Ok();
   }
 
   Result<None> compileReturn(const Return& node) {
-    this->out << "return";
+    this->out.write("return");
     if (node.expression.has_value()) {
-      this->out << " ";
+      this->out.writeChar(' ');
       TRY(this->compileExpression(node.expression.value()));
     }
     return Ok();
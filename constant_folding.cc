@@ -0,0 +1,225 @@
+#ifndef CONSTANT_FOLDING_CC
+#define CONSTANT_FOLDING_CC
+
+#include <charconv>
+#include <cmath>
+
+#include "ast.cc"
+#include "builtins.cc"
+#include "scoped_symbol_map.cc"
+
+// Parses the text of a number literal, leaving it unknown if it doesn't fit
+// the type it will have in C.
+Constant parseNumber(StringView text) {
+  Constant constant;
+  const char* end = text.data() + text.size();
+  if (text.find('.') != StringView::npos) {
+    auto [ptr, error] = std::from_chars(text.data(), end, constant.floatValue);
+    if (error == std::errc() && ptr == end) {
+      constant.type = BaseType::FLOAT;
+    }
+    return constant;
+  }
+  auto [ptr, error] = std::from_chars(text.data(), end, constant.intValue);
+  if (error == std::errc() && ptr == end && constant.intValue <= INT32_MAX) {
+    constant.type = BaseType::INT;
+  }
+  return constant;
+}
+
+// Applies the operator to two known operands of the same type. The result is
+// left unknown when it couldn't be computed exactly as C would at runtime.
+Constant evaluateBinaryOperator(BinaryOperator op, Constant left,
+                                Constant right) {
+  Constant result;
+  if (left.type == BaseType::INT) {
+    int64_t a = left.intValue;
+    int64_t b = right.intValue;
+    switch (op) {
+      case BinaryOperator::ADD:
+        result.intValue = a + b;
+        break;
+      case BinaryOperator::SUBTRACT:
+        result.intValue = a - b;
+        break;
+      case BinaryOperator::EQUAL:
+        result.intValue = a == b;
+        break;
+      case BinaryOperator::NOT_EQUAL:
+        result.intValue = a != b;
+        break;
+      case BinaryOperator::LESS:
+        result.intValue = a < b;
+        break;
+      case BinaryOperator::LESS_EQUAL:
+        result.intValue = a <= b;
+        break;
+      case BinaryOperator::GREATER:
+        result.intValue = a > b;
+        break;
+      case BinaryOperator::GREATER_EQUAL:
+        result.intValue = a >= b;
+        break;
+    }
+    // Overflowing an int is undefined in C, so leave it to happen at runtime.
+    if (result.intValue >= INT32_MIN && result.intValue <= INT32_MAX) {
+      result.type = BaseType::INT;
+    }
+    return result;
+  }
+
+  double a = left.floatValue;
+  double b = right.floatValue;
+  // Comparisons result in an INT, like in C.
+  result.type = BaseType::INT;
+  switch (op) {
+    case BinaryOperator::ADD:
+      result.type = BaseType::FLOAT;
+      result.floatValue = a + b;
+      break;
+    case BinaryOperator::SUBTRACT:
+      result.type = BaseType::FLOAT;
+      result.floatValue = a - b;
+      break;
+    case BinaryOperator::EQUAL:
+      result.intValue = a == b;
+      break;
+    case BinaryOperator::NOT_EQUAL:
+      result.intValue = a != b;
+      break;
+    case BinaryOperator::LESS:
+      result.intValue = a < b;
+      break;
+    case BinaryOperator::LESS_EQUAL:
+      result.intValue = a <= b;
+      break;
+    case BinaryOperator::GREATER:
+      result.intValue = a > b;
+      break;
+    case BinaryOperator::GREATER_EQUAL:
+      result.intValue = a >= b;
+      break;
+  }
+  if (result.type == BaseType::FLOAT && !std::isfinite(result.floatValue)) {
+    result.type = BaseType::VOID;
+  }
+  return result;
+}
+
+// Computes numbers at compile time. Number literals are parsed once, binary
+// expressions with known operands are replaced by their result, and
+// references to variables with a known value are replaced by the value.
+// Variables are immutable, so a variable's value is the same everywhere it's
+// visible. Must run after the Analyzer, since operands are assumed to have
+// the same type and declarations their inferred types.
+struct ConstantFolder {
+  Ast* ast;
+  // Values of the parameters and variables visible in the current scope,
+  // which are unknown for parameters and variables computed at runtime.
+  ScopedSymbolMap<Constant> variables;
+  // Number of expressions replaced by a number.
+  size_t foldedCount = 0;
+
+  void foldProgram(Program& program) {
+    this->ast = &program.ast;
+    for (const auto& function : program.functions) {
+      this->foldFunctionDeclaration(function);
+    }
+  }
+
+  void foldFunctionDeclaration(const FunctionDeclaration& node) {
+    this->variables.pushScope();
+    for (const auto& param : this->ast->get(node.params)) {
+      this->variables.set(param.name, Constant());
+    }
+    this->foldStatementBlock(node.body);
+    this->variables.popScope();
+  }
+
+  void foldStatementBlock(const StatementBlock& node) {
+    this->variables.pushScope();
+    for (const auto& statement : this->ast->get(node.statements)) {
+      this->foldStatement(statement);
+    }
+    this->variables.popScope();
+  }
+
+  // Folds the expressions in the statement. Nodes are only ever added to the
+  // NumberLiteral pool, so references to other nodes stay valid while folding.
+  void foldStatement(const Statement& node) {
+    visit(*this->ast, node,
+          Overloaded{[&](VariableDeclaration& node) {
+                       node.expression = this->foldExpression(node.expression);
+                       this->variables.set(node.name,
+                                           this->getConstant(node.expression));
+                     },
+                     [&](FunctionCall& node) { this->foldArguments(node); },
+                     [&](Return& node) {
+                       if (node.expression.has_value()) {
+                         node.expression =
+                             this->foldExpression(node.expression.value());
+                       }
+                     }});
+  }
+
+  // Returns the expression to use in place of the given one.
+  Expression foldExpression(const Expression& node) {
+    return visit(
+        *this->ast, node,
+        Overloaded{[&](VariableReference& reference) {
+                     const Constant* value =
+                         this->variables.get(reference.name);
+                     if (value == nullptr || !value->isKnown()) {
+                       return node;
+                     }
+                     return this->addNumber(*value, reference.location);
+                   },
+                   [&](FunctionCall& call) {
+                     this->foldArguments(call);
+                     return node;
+                   },
+                   [&](NumberLiteral& literal) {
+                     literal.constant = parseNumber(literal.value);
+                     return node;
+                   },
+                   [&](StringLiteral&) { return node; },
+                   [&](BinaryExpression& binary) {
+                     binary.left = this->foldExpression(binary.left);
+                     binary.right = this->foldExpression(binary.right);
+                     Constant left = this->getConstant(binary.left);
+                     Constant right = this->getConstant(binary.right);
+                     if (!left.isKnown() || !right.isKnown()) {
+                       return node;
+                     }
+                     Constant result =
+                         evaluateBinaryOperator(binary.op, left, right);
+                     if (!result.isKnown()) {
+                       return node;
+                     }
+                     return this->addNumber(result, binary.location);
+                   }});
+  }
+
+  void foldArguments(const FunctionCall& node) {
+    for (auto& arg : this->ast->get(node.args)) {
+      arg = this->foldExpression(arg);
+    }
+  }
+
+  // Returns the value of the expression if it's a number known at compile
+  // time.
+  Constant getConstant(const Expression& node) {
+    if (!node.is<NumberLiteral>()) {
+      return Constant();
+    }
+    return this->ast->get<NumberLiteral>(node).constant;
+  }
+
+  Expression addNumber(Constant value, Location location) {
+    this->foldedCount++;
+    return this->ast->addExpression(
+        NumberLiteral{.location = location, .constant = value});
+  }
+};
+
+#endif  // CONSTANT_FOLDING_CC
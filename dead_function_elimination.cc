@@ -0,0 +1,34 @@
+#ifndef DEAD_FUNCTION_ELIMINATION_CC
+#define DEAD_FUNCTION_ELIMINATION_CC
+
+#include "ast.cc"
+#include "builtins.cc"
+#include "call_graph.cc"
+
+// Removes the functions that neither main nor an exported function can end up
+// calling, so no C is generated for them. Must run after the Analyzer, which
+// builds the call graph, and renumbers the graph to match. Returns the number
+// of functions removed.
+size_t eliminateDeadFunctions(Program& program) {
+  Vector<FunctionDeclaration>& functions = program.functions;
+  Vector<uint32_t> roots;
+  for (uint32_t i = 0; i < functions.size(); i++) {
+    if (functions[i].name == Symbol::MAIN || functions[i].isExported) {
+      roots.push_back(i);
+    }
+  }
+  Vector<bool> reachable = program.callGraph.getReachable(roots);
+
+  size_t keptCount = 0;
+  for (size_t i = 0; i < functions.size(); i++) {
+    if (reachable[i]) {
+      functions[keptCount++] = std::move(functions[i]);
+    }
+  }
+  size_t removedCount = functions.size() - keptCount;
+  functions.erase(functions.begin() + keptCount, functions.end());
+  program.callGraph = program.callGraph.filter(reachable);
+  return removedCount;
+}
+
+#endif  // DEAD_FUNCTION_ELIMINATION_CC
@@ -0,0 +1,179 @@
+#ifndef ESCAPE_ANALYSIS_CC
+#define ESCAPE_ANALYSIS_CC
+
+#include "ast.cc"
+#include "builtins.cc"
+#include "scoped_symbol_map.cc"
+
+// Variable whose value is allocated where it's declared, which is a string
+// variable given a string literal.
+struct Allocation {
+  Symbol function;
+  VariableDeclaration* declaration;
+  // Node of the variable in the EscapeAnalyzer's graph.
+  uint32_t node;
+};
+
+// Value handed from one parameter or variable to another, or returned.
+struct Flow {
+  uint32_t from;
+  uint32_t to;
+};
+
+// Finds the allocations whose value never outlives the function making them,
+// which can live on the stack without a refcount. A value escapes when it's
+// returned, handed to a parameter that escapes, or bound to a variable that
+// escapes, whether directly or through a fork. Builtins never keep their
+// arguments. Must run after the Analyzer.
+//
+// Every parameter and variable of the program is a node of one graph, with an
+// edge to wherever its value is handed. A single search backwards from the
+// returned node finds every value that escapes, however calls are nested or
+// recursive.
+struct EscapeAnalyzer {
+  // Node standing for the return value of every function.
+  static constexpr uint32_t RETURNED = 0;
+
+  Ast* ast;
+  // Node of the first parameter of each function.
+  ScopedSymbolMap<uint32_t> functions;
+  // Nodes of the parameters and variables visible in the current scope.
+  ScopedSymbolMap<uint32_t> variables;
+  Vector<Flow> flows;
+  Vector<Allocation> allocations;
+  uint32_t nodeCount = RETURNED + 1;
+  // Number of allocations moved to the stack.
+  size_t promotedCount = 0;
+
+  void analyzeProgram(Program& program) {
+    this->ast = &program.ast;
+    // Number every parameter first, since functions can be called before
+    // they are declared.
+    for (const auto& function : program.functions) {
+      this->functions.set(function.name, this->nodeCount);
+      this->nodeCount += function.params.size();
+    }
+    for (const auto& function : program.functions) {
+      this->analyzeFunctionDeclaration(function);
+    }
+
+    Vector<bool> escapes = this->findEscapes();
+    for (auto& allocation : this->allocations) {
+      allocation.declaration->isOnStack = !escapes[allocation.node];
+      this->promotedCount += allocation.declaration->isOnStack;
+    }
+  }
+
+  void analyzeFunctionDeclaration(const FunctionDeclaration& node) {
+    this->variables.pushScope();
+    uint32_t firstParameter = *this->functions.get(node.name);
+    Span<const FunctionParameter> params = this->ast->get(node.params);
+    for (uint32_t i = 0; i < params.size(); i++) {
+      this->variables.set(params[i].name, firstParameter + i);
+    }
+
+    this->variables.pushScope();
+    for (const auto& statement : this->ast->get(node.body.statements)) {
+      visit(*this->ast, statement,
+            Overloaded{[&](VariableDeclaration& declaration) {
+                         this->analyzeVariableDeclaration(node.name,
+                                                          declaration);
+                       },
+                       [&](const FunctionCall& call) {
+                         this->analyzeFunctionCall(call);
+                       },
+                       [&](const Return& ret) {
+                         if (ret.expression.has_value()) {
+                           this->analyzeExpression(ret.expression.value());
+                           this->handOver(ret.expression.value(), RETURNED);
+                         }
+                       }});
+    }
+    this->variables.popScope();
+    this->variables.popScope();
+  }
+
+  void analyzeVariableDeclaration(Symbol function, VariableDeclaration& node) {
+    this->analyzeExpression(node.expression);
+    uint32_t variable = this->nodeCount++;
+    this->handOver(node.expression, variable);
+    this->variables.set(node.name, variable);
+    if (node.type.equals(BaseType::STRING) &&
+        node.expression.is<StringLiteral>()) {
+      this->allocations.push_back(Allocation{
+          .function = function, .declaration = &node, .node = variable});
+    }
+  }
+
+  // Finds the calls within the expression.
+  void analyzeExpression(const Expression& node) {
+    if (node.is<FunctionCall>()) {
+      this->analyzeFunctionCall(this->ast->get<FunctionCall>(node));
+    } else if (node.is<BinaryExpression>()) {
+      const BinaryExpression& binary = this->ast->get<BinaryExpression>(node);
+      this->analyzeExpression(binary.left);
+      this->analyzeExpression(binary.right);
+    }
+  }
+
+  void analyzeFunctionCall(const FunctionCall& node) {
+    const uint32_t* firstParameter = this->functions.get(node.name);
+    Span<const Expression> args = this->ast->get(node.args);
+    for (uint32_t i = 0; i < args.size(); i++) {
+      this->analyzeExpression(args[i]);
+      if (firstParameter != nullptr) {
+        this->handOver(args[i], *firstParameter + i);
+      }
+    }
+  }
+
+  // Adds a flow to the given node if the expression is the value of a
+  // parameter or variable, or a fork of one.
+  void handOver(const Expression& node, uint32_t to) {
+    Expression value = node;
+    if (node.is<FunctionCall>()) {
+      const FunctionCall& call = this->ast->get<FunctionCall>(node);
+      if (call.name != Symbol::FORK) {
+        return;
+      }
+      value = this->ast->get(call.args)[0];
+    }
+    if (value.is<VariableReference>()) {
+      Symbol name = this->ast->get<VariableReference>(value).name;
+      this->flows.push_back(Flow{.from = *this->variables.get(name), .to = to});
+    }
+  }
+
+  // Returns which nodes have a path of flows to the returned node.
+  Vector<bool> findEscapes() {
+    // Group the flows by where they go, so each node's sources are
+    // contiguous.
+    std::sort(this->flows.begin(), this->flows.end(),
+              [](const Flow& a, const Flow& b) { return a.to < b.to; });
+    Vector<uint32_t> flowStarts(this->nodeCount + 1);
+    for (const auto& flow : this->flows) {
+      flowStarts[flow.to + 1]++;
+    }
+    for (uint32_t node = 0; node < this->nodeCount; node++) {
+      flowStarts[node + 1] += flowStarts[node];
+    }
+
+    Vector<bool> escapes(this->nodeCount);
+    Vector<uint32_t> stack = {RETURNED};
+    escapes[RETURNED] = true;
+    while (!stack.empty()) {
+      uint32_t node = stack.back();
+      stack.pop_back();
+      for (uint32_t i = flowStarts[node]; i < flowStarts[node + 1]; i++) {
+        uint32_t from = this->flows[i].from;
+        if (!escapes[from]) {
+          escapes[from] = true;
+          stack.push_back(from);
+        }
+      }
+    }
+    return escapes;
+  }
+};
+
+#endif  // ESCAPE_ANALYSIS_CC
@@ -1,6 +1,13 @@
 #ifndef FILE_CC
 #define FILE_CC
 
+#include <fcntl.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <climits>
+#include <cstring>
 #include <fstream>
 #include <sstream>
 
@@ -17,14 +24,50 @@ Result<String> readFile(StringView fileName) {
   return Ok(buffer.str());
 }
 
-Result<None> writeFile(StringView fileName, StringView fileContents) {
-  OfStream outputFile(fileName.data());
-  if (!outputFile.is_open()) {
+// Creates the file, or empties it if it exists, returning a file descriptor
+// to write to it.
+Result<int> createFile(StringView fileName) {
+  int fd = open(String(fileName).c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0) {
     return Error("Could not open file: {}.", fileName);
   }
-  outputFile << fileContents;
-  outputFile.close();
+  return Ok(fd);
+}
+
+// Writes all of the pieces to the file descriptor in order, with as few
+// system calls as the descriptor allows. Retries writes that were interrupted
+// or only partly done, which happens with pipes.
+Result<None> writeAll(int fd, Span<iovec> pieces) {
+  size_t next = 0;
+  while (next < pieces.size()) {
+    size_t count = std::min(pieces.size() - next, (size_t)IOV_MAX);
+    ssize_t written = writev(fd, pieces.data() + next, count);
+    if (written < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return Error("Could not write the output: {}.", strerror(errno));
+    }
+    // Skip the pieces written in full, then what was written of the next.
+    while (next < pieces.size() && (size_t)written >= pieces[next].iov_len) {
+      written -= pieces[next].iov_len;
+      next++;
+    }
+    if (next < pieces.size()) {
+      pieces[next].iov_base = (char*)pieces[next].iov_base + written;
+      pieces[next].iov_len -= written;
+    }
+  }
   return Ok();
 }
 
+Result<None> writeFile(StringView fileName, StringView fileContents) {
+  TRY(int fd, createFile(fileName));
+  iovec piece = {.iov_base = (void*)fileContents.data(),
+                 .iov_len = fileContents.size()};
+  Result<None> result = writeAll(fd, Span<iovec>(&piece, 1));
+  close(fd);
+  return result;
+}
+
 #endif  // FILE_CC
\ No newline at end of file
@@ -0,0 +1,349 @@
+#ifndef INLINER_CC
+#define INLINER_CC
+
+#include "ast.cc"
+#include "builtins.cc"
+#include "call_graph.cc"
+#include "scoped_symbol_map.cc"
+
+// Largest number of nodes in a function's returned expression for calls to
+// it to be inlined.
+const size_t MAX_INLINE_SIZE = 8;
+
+// Replaces calls to small leaf functions with the expression they return.
+// Only functions whose body is a single return of an expression are inlined,
+// like accessors and wrappers. The expression only refers to parameters, so
+// substituting the arguments for them can't capture any of the caller's
+// names. Must run after the Analyzer, and before dead function elimination so
+// functions no longer called are removed.
+struct Inliner {
+  Program* program;
+  // Index of every function of the program.
+  ScopedSymbolMap<uint32_t> functions;
+  // Name of the function whose calls are being inlined.
+  Symbol currentFunction;
+  // Whether each argument of the call being inlined was placed yet.
+  Vector<bool> argumentUsed;
+  Vector<Expression> argumentScratch;
+  // Names the returned expression of the function being checked refers to.
+  Vector<Symbol> uses;
+  size_t inlinedCount = 0;
+  // Whether to describe every decision in decisions.
+  bool reportDecisions = false;
+  Vector<String> decisions;
+
+  void inlineProgram(Program& program) {
+    this->program = &program;
+    for (uint32_t i = 0; i < program.functions.size(); i++) {
+      this->functions.set(program.functions[i].name, i);
+    }
+    for (const auto& function : program.functions) {
+      this->currentFunction = function.name;
+      for (Statement statement : program.ast.get(function.body.statements)) {
+        this->inlineStatement(statement);
+      }
+    }
+    this->rebuildCallGraph();
+  }
+
+  Ast& getAst() { return this->program->ast; }
+
+  void inlineStatement(Statement node) {
+    Ast& ast = this->getAst();
+    if (node.is<VariableDeclaration>()) {
+      Expression expression = ast.get<VariableDeclaration>(node).expression;
+      expression = this->inlineExpression(expression);
+      ast.get<VariableDeclaration>(node).expression = expression;
+    } else if (node.is<FunctionCall>()) {
+      // The value of a call statement is discarded, so only its arguments can
+      // have calls inlined.
+      this->inlineArguments(ast.get<FunctionCall>(node).args);
+    } else if (node.is<Return>()) {
+      Optional<Expression> expression = ast.get<Return>(node).expression;
+      if (expression.has_value()) {
+        expression = this->inlineExpression(expression.value());
+        ast.get<Return>(node).expression = expression;
+      }
+    }
+  }
+
+  // Returns the expression to use in place of the given one. Nodes are added
+  // while inlining, so nodes are looked up again after every change instead
+  // of holding references to them.
+  Expression inlineExpression(Expression node) {
+    Ast& ast = this->getAst();
+    if (node.is<BinaryExpression>()) {
+      Expression left = this->inlineExpression(
+          ast.get<BinaryExpression>(node).left);
+      Expression right = this->inlineExpression(
+          ast.get<BinaryExpression>(node).right);
+      ast.get<BinaryExpression>(node).left = left;
+      ast.get<BinaryExpression>(node).right = right;
+      return node;
+    }
+    if (!node.is<FunctionCall>()) {
+      return node;
+    }
+    this->inlineArguments(ast.get<FunctionCall>(node).args);
+    return this->inlineCall(node);
+  }
+
+  void inlineArguments(Range<Expression> args) {
+    for (uint32_t i = 0; i < args.size(); i++) {
+      Expression arg = this->getAst().get(args)[i];
+      arg = this->inlineExpression(arg);
+      this->getAst().get(args)[i] = arg;
+    }
+  }
+
+  Expression inlineCall(Expression node) {
+    Ast& ast = this->getAst();
+    FunctionCall call = ast.get<FunctionCall>(node);
+    const uint32_t* calleeIndex = this->functions.get(call.name);
+    if (calleeIndex == nullptr) {
+      return node;
+    }
+    const FunctionDeclaration& callee = this->program->functions[*calleeIndex];
+    Optional<String> reason = this->getReasonNotToInline(callee, call);
+    if (reason.has_value()) {
+      this->report(call, "Didn't inline", ", since " + reason.value());
+      return node;
+    }
+
+    Expression body =
+        ast.get<Return>(ast.get(callee.body.statements)[0]).expression.value();
+    this->argumentUsed.assign(call.args.size(), false);
+    Expression inlined = this->cloneExpression(body, callee, call.args);
+    this->inlinedCount++;
+    this->report(call, "Inlined", "");
+    return inlined;
+  }
+
+  void report(const FunctionCall& call, StringView decision,
+              StringView reason) {
+    if (this->reportDecisions) {
+      this->decisions.push_back(std::format(
+          "{} {} into {} at {}{}.", decision, symbolTable.getName(call.name),
+          symbolTable.getName(this->currentFunction), call.location, reason));
+    }
+  }
+
+  Optional<String> getReasonNotToInline(const FunctionDeclaration& callee,
+                                        const FunctionCall& call) {
+    Ast& ast = this->getAst();
+    Span<const Statement> statements = ast.get(callee.body.statements);
+    if (statements.size() != 1 || !statements[0].is<Return>() ||
+        !ast.get<Return>(statements[0]).expression.has_value()) {
+      return "its body isn't a single return of a value";
+    }
+    uint32_t calleeIndex = *this->functions.get(callee.name);
+    if (!this->program->callGraph.getCallees(calleeIndex).empty()) {
+      return "it isn't a leaf";
+    }
+    Expression body = ast.get<Return>(statements[0]).expression.value();
+    size_t size = this->getSize(body);
+    if (size > MAX_INLINE_SIZE) {
+      return std::format("it has {} nodes", size);
+    }
+    if (this->hasFork(body)) {
+      return "it forks";
+    }
+
+    // Arguments that may have side effects must be evaluated exactly once,
+    // and in the order they were passed, so each must be used once and after
+    // the ones before it.
+    Span<const FunctionParameter> params = ast.get(callee.params);
+    Span<const Expression> args = ast.get(call.args);
+    this->uses.clear();
+    this->collectUses(body);
+    size_t lastUse = 0;
+    uint32_t lastArgument = 0;
+    for (uint32_t i = 0; i < params.size(); i++) {
+      bool isSimple = args[i].is<VariableReference>() ||
+                      args[i].is<NumberLiteral>() ||
+                      args[i].is<StringLiteral>();
+      if (isSimple) {
+        continue;
+      }
+      size_t useCount = std::count(this->uses.begin(), this->uses.end(),
+                                   params[i].name);
+      if (useCount != 1) {
+        return std::format("argument {} would be evaluated {} times", i + 1,
+                           useCount);
+      }
+      size_t use = std::find(this->uses.begin(), this->uses.end(),
+                             params[i].name) -
+                   this->uses.begin() + 1;
+      if (use < lastUse) {
+        return std::format("argument {} would be evaluated before argument {}",
+                           i + 1, lastArgument + 1);
+      }
+      lastUse = use;
+      lastArgument = i;
+    }
+    return std::nullopt;
+  }
+
+  // Number of nodes in the expression.
+  size_t getSize(Expression node) {
+    Ast& ast = this->getAst();
+    if (node.is<BinaryExpression>()) {
+      const BinaryExpression& binary = ast.get<BinaryExpression>(node);
+      return 1 + this->getSize(binary.left) + this->getSize(binary.right);
+    }
+    size_t size = 1;
+    if (node.is<FunctionCall>()) {
+      for (Expression arg : ast.get(ast.get<FunctionCall>(node).args)) {
+        size += this->getSize(arg);
+      }
+    }
+    return size;
+  }
+
+  bool hasFork(Expression node) {
+    Ast& ast = this->getAst();
+    if (node.is<BinaryExpression>()) {
+      const BinaryExpression& binary = ast.get<BinaryExpression>(node);
+      return this->hasFork(binary.left) || this->hasFork(binary.right);
+    }
+    if (!node.is<FunctionCall>()) {
+      return false;
+    }
+    const FunctionCall& call = ast.get<FunctionCall>(node);
+    if (call.name == Symbol::FORK) {
+      return true;
+    }
+    for (Expression arg : ast.get(call.args)) {
+      if (this->hasFork(arg)) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  // Collects the names the expression refers to in uses, in the order
+  // they're evaluated.
+  void collectUses(Expression node) {
+    Ast& ast = this->getAst();
+    if (node.is<VariableReference>()) {
+      this->uses.push_back(ast.get<VariableReference>(node).name);
+    } else if (node.is<BinaryExpression>()) {
+      const BinaryExpression& binary = ast.get<BinaryExpression>(node);
+      this->collectUses(binary.left);
+      this->collectUses(binary.right);
+    } else if (node.is<FunctionCall>()) {
+      for (Expression arg : ast.get(ast.get<FunctionCall>(node).args)) {
+        this->collectUses(arg);
+      }
+    }
+  }
+
+  // Copies the callee's expression, replacing its parameters with the
+  // arguments. An argument is placed as is the first time, and copied for any
+  // further uses, which getReasonNotToInline() only allows for simple ones.
+  Expression cloneExpression(Expression node,
+                             const FunctionDeclaration& callee,
+                             Range<Expression> args) {
+    Ast& ast = this->getAst();
+    switch (node.kind) {
+      case NodeKind::VARIABLE_REFERENCE: {
+        Symbol name = ast.get<VariableReference>(node).name;
+        Span<const FunctionParameter> params = ast.get(callee.params);
+        for (uint32_t i = 0; i < params.size(); i++) {
+          if (params[i].name == name) {
+            Expression arg = ast.get(args)[i];
+            if (this->argumentUsed[i]) {
+              return this->copySimpleExpression(arg);
+            }
+            this->argumentUsed[i] = true;
+            return arg;
+          }
+        }
+        return node;
+      }
+      case NodeKind::BINARY_EXPRESSION: {
+        BinaryExpression binary = ast.get<BinaryExpression>(node);
+        binary.left = this->cloneExpression(binary.left, callee, args);
+        binary.right = this->cloneExpression(binary.right, callee, args);
+        return ast.addExpression(binary);
+      }
+      case NodeKind::FUNCTION_CALL: {
+        FunctionCall call = ast.get<FunctionCall>(node);
+        size_t scratchStart = this->argumentScratch.size();
+        for (uint32_t i = 0; i < call.args.size(); i++) {
+          Expression arg = this->cloneExpression(ast.get(call.args)[i], callee,
+                                                 args);
+          this->argumentScratch.push_back(arg);
+        }
+        call.args = ast.addRange(this->argumentScratch, scratchStart);
+        return ast.addExpression(call);
+      }
+      case NodeKind::NUMBER_LITERAL:
+        return ast.addExpression(ast.get<NumberLiteral>(node));
+      case NodeKind::STRING_LITERAL:
+        return ast.addExpression(ast.get<StringLiteral>(node));
+      default:
+        __builtin_unreachable();
+    }
+  }
+
+  Expression copySimpleExpression(Expression node) {
+    Ast& ast = this->getAst();
+    if (node.is<VariableReference>()) {
+      return ast.addExpression(ast.get<VariableReference>(node));
+    } else if (node.is<NumberLiteral>()) {
+      return ast.addExpression(ast.get<NumberLiteral>(node));
+    }
+    return ast.addExpression(ast.get<StringLiteral>(node));
+  }
+
+  // Collects the calls left after inlining into a new call graph.
+  void rebuildCallGraph() {
+    Vector<Call> calls;
+    for (uint32_t i = 0; i < this->program->functions.size(); i++) {
+      const FunctionDeclaration& function = this->program->functions[i];
+      for (Statement statement :
+           this->getAst().get(function.body.statements)) {
+        visit(this->getAst(), statement,
+              Overloaded{[&](const VariableDeclaration& node) {
+                           this->collectCalls(i, node.expression, calls);
+                         },
+                         [&](const FunctionCall& node) {
+                           this->collectCall(i, node, calls);
+                         },
+                         [&](const Return& node) {
+                           if (node.expression.has_value()) {
+                             this->collectCalls(i, node.expression.value(),
+                                                calls);
+                           }
+                         }});
+      }
+    }
+    this->program->callGraph =
+        CallGraph::build(this->program->functions.size(), std::move(calls));
+  }
+
+  void collectCalls(uint32_t caller, Expression node, Vector<Call>& calls) {
+    if (node.is<BinaryExpression>()) {
+      const BinaryExpression& binary =
+          this->getAst().get<BinaryExpression>(node);
+      this->collectCalls(caller, binary.left, calls);
+      this->collectCalls(caller, binary.right, calls);
+    } else if (node.is<FunctionCall>()) {
+      this->collectCall(caller, this->getAst().get<FunctionCall>(node), calls);
+    }
+  }
+
+  void collectCall(uint32_t caller, const FunctionCall& node,
+                   Vector<Call>& calls) {
+    const uint32_t* callee = this->functions.get(node.name);
+    if (callee != nullptr) {
+      calls.push_back(Call{.caller = caller, .callee = *callee});
+    }
+    for (Expression arg : this->getAst().get(node.args)) {
+      this->collectCalls(caller, arg, calls);
+    }
+  }
+};
+
+#endif  // INLINER_CC
@@ -0,0 +1,39 @@
+#ifndef LOCATION_CC
+#define LOCATION_CC
+
+#include <algorithm>
+#include <cstring>
+
+#include "builtins.cc"
+
+// Offsets at which every line of the code starts, so that the location of a
+// position is a binary search rather than a rescan of the code.
+struct LineIndex {
+  Vector<size_t> lineStarts;
+
+  bool isBuilt() { return !this->lineStarts.empty(); }
+
+  void build(StringView code) {
+    this->lineStarts.clear();
+    this->lineStarts.push_back(0);
+    const char* data = code.data();
+    const char* dataEnd = data + code.length();
+    const char* newline = data;
+    while ((newline = (const char*)memchr(newline, '\n', dataEnd - newline))) {
+      newline++;
+      this->lineStarts.push_back(newline - data);
+    }
+  }
+
+  Location getLocation(size_t position) {
+    // Find the last line that starts at or before the position.
+    auto lineStart = std::upper_bound(this->lineStarts.begin(),
+                                      this->lineStarts.end(), position) -
+                     1;
+    int line = lineStart - this->lineStarts.begin() + 1;
+    int col = position - *lineStart + 1;
+    return {.line = line, .col = col};
+  }
+};
+
+#endif  // LOCATION_CC
@@ -0,0 +1,102 @@
+#ifndef MIR_CC
+#define MIR_CC
+
+#include "ast.cc"
+#include "builtins.cc"
+
+// Mid-level IR, which sits between the analyzed AST and C. Each function is a
+// list of basic blocks of three-address instructions in SSA form: every
+// instruction defines one typed value, which is never reassigned, and its
+// operands are values defined before it. Variables disappear when lowering,
+// since a reference to a variable is just the value it was bound to.
+//
+// Values are numbered by the instruction defining them, and instructions,
+// operands and constants of a function each live in one flat array, so a pass
+// walks plain arrays instead of trees of nodes.
+
+// Index of the instruction defining a value in MirFunction::instructions.
+using MirValue = uint32_t;
+const MirValue NO_VALUE = UINT32_MAX;
+
+// Opcode enum and their string names for the textual dump.
+#define FOREACH_MIR_OPCODE(GENERATOR) \
+  GENERATOR(PARAM)                    \
+  GENERATOR(NUMBER)                   \
+  GENERATOR(STRING)                   \
+  GENERATOR(BINARY)                   \
+  GENERATOR(CALL)                     \
+  GENERATOR(FORK)
+enum class MirOpcode : uint8_t { FOREACH_MIR_OPCODE(ENUM_GENERATOR) };
+static const char* mirOpcodeString[] = {FOREACH_MIR_OPCODE(STRING_GENERATOR)};
+String mirOpcodeToString(MirOpcode opcode) {
+  return mirOpcodeString[static_cast<int>(opcode)];
+}
+
+struct MirInstruction {
+  MirOpcode opcode;
+  // Operator of a BINARY.
+  BinaryOperator op = BinaryOperator::EQUAL;
+  // Whether a FORK is the last use of its operand, so it moves the value.
+  bool isMove = false;
+  // Type of the value, which is VOID for calls that return nothing.
+  BaseType type;
+  // Name of a PARAM, or the function a CALL calls.
+  Symbol name = {};
+  // Index of a PARAM among the parameters, of a NUMBER in
+  // MirFunction::constants or of a STRING in MirFunction::strings.
+  uint32_t immediate = 0;
+  // Operands of a BINARY, CALL or FORK in MirFunction::operands.
+  Range<MirValue> operands;
+};
+
+// Run of instructions executed in order, ending in a terminator. Every block
+// ends in a return until the language has control flow.
+struct MirBlock {
+  uint32_t instructionStart = 0;
+  uint32_t instructionCount = 0;
+  // Value returned, or NO_VALUE to return nothing.
+  MirValue returnValue = NO_VALUE;
+};
+
+// Function lowered to MIR. The entry block is the first one, and starts with
+// a PARAM for each parameter in order.
+struct MirFunction {
+  Symbol name;
+  BaseType returnType;
+  uint32_t paramCount = 0;
+  bool isExported = false;
+  Vector<MirBlock> blocks;
+  // Instructions of every block, with each block's instructions contiguous
+  // and blocks in order.
+  Vector<MirInstruction> instructions;
+  Vector<MirValue> operands;
+  Vector<Constant> constants;
+  // String literals as they appear in the source, quotes included.
+  Vector<StringView> strings;
+
+  Span<const MirValue> getOperands(const MirInstruction& instruction) const {
+    return Span<const MirValue>(
+        this->operands.data() + instruction.operands.start,
+        instruction.operands.count);
+  }
+
+  // Adds the instruction to the end of the last block, returning its value.
+  MirValue add(MirInstruction instruction, Span<const MirValue> operands) {
+    instruction.operands = {.start = (uint32_t)this->operands.size(),
+                            .count = (uint32_t)operands.size()};
+    this->operands.insert(this->operands.end(), operands.begin(),
+                          operands.end());
+    this->instructions.push_back(instruction);
+    this->blocks.back().instructionCount++;
+    return this->instructions.size() - 1;
+  }
+};
+
+struct MirProgram {
+  OrderedSet<String> includes;
+  Vector<MirFunction> functions;
+  // Bytes of source the program was parsed from.
+  size_t sourceSize = 0;
+};
+
+#endif  // MIR_CC
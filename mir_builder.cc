@@ -0,0 +1,229 @@
+#ifndef MIR_BUILDER_CC
+#define MIR_BUILDER_CC
+
+#include <cassert>
+
+#include "ast.cc"
+#include "builtins.cc"
+#include "constant_folding.cc"
+#include "mir.cc"
+#include "scoped_symbol_map.cc"
+
+// Lowers the analyzed program to MIR. Must run after the Analyzer, since
+// types are taken as checked and declarations as having their inferred types.
+// The Analyzer also rejects functions that can end without returning a value
+// and numbers that don't fit their type, so those are asserted here.
+// Constant folding and dead function elimination may run before, but needn't.
+struct MirBuilder {
+  const Ast* ast;
+  // Return type of every function of the program.
+  ScopedSymbolMap<BaseType> returnTypes;
+  // Value of the parameters and variables visible in the current scope.
+  ScopedSymbolMap<MirValue> variables;
+  // Function being built.
+  MirFunction* function;
+  // Whether the last block ended in a return.
+  bool isBlockEnded;
+  Vector<MirValue> operandScratch;
+
+  Result<MirProgram> buildProgram(const Program& node) {
+    this->ast = &node.ast;
+    for (const auto& function : node.functions) {
+      TRY(BaseType returnType,
+          this->getBaseType(function.returnType, function.returnTypeLocation));
+      this->returnTypes.set(function.name, returnType);
+    }
+
+    MirProgram program = {.includes = node.includes,
+                          .sourceSize = node.sourceSize};
+    program.functions.resize(node.functions.size());
+    for (size_t i = 0; i < node.functions.size(); i++) {
+      TRY(this->buildFunction(node.functions[i], program.functions[i]));
+    }
+    return Ok(std::move(program));
+  }
+
+  Result<None> buildFunction(const FunctionDeclaration& node,
+                             MirFunction& function) {
+    this->function = &function;
+    function.name = node.name;
+    function.returnType = *this->returnTypes.get(node.name);
+    function.isExported = node.isExported;
+    function.blocks.push_back(MirBlock());
+    this->isBlockEnded = false;
+
+    this->variables.pushScope();
+    Span<const FunctionParameter> params = this->ast->get(node.params);
+    function.paramCount = params.size();
+    for (uint32_t i = 0; i < params.size(); i++) {
+      TRY(BaseType type, this->getBaseType(params[i].type, params[i].location));
+      MirValue value = function.add(MirInstruction{.opcode = MirOpcode::PARAM,
+                                                   .type = type,
+                                                   .name = params[i].name,
+                                                   .immediate = i},
+                                    {});
+      this->variables.set(params[i].name, value);
+    }
+    for (const auto& statement : this->ast->get(node.body.statements)) {
+      TRY(this->buildStatement(statement));
+    }
+    this->variables.popScope();
+    if (!this->isBlockEnded) {
+      this->endBlock(NO_VALUE);
+    }
+    return Ok();
+  }
+
+  Result<None> buildStatement(const Statement& node) {
+    // Statements after a return are never run, but are still lowered to a
+    // block of their own so they are checked and emitted like the rest.
+    if (this->isBlockEnded) {
+      this->function->blocks.push_back(MirBlock{
+          .instructionStart = (uint32_t)this->function->instructions.size()});
+      this->isBlockEnded = false;
+    }
+    return visit(*this->ast, node,
+                 Overloaded{[&](const VariableDeclaration& node) {
+                              return this->buildVariableDeclaration(node);
+                            },
+                            [&](const FunctionCall& node) -> Result<None> {
+                              // The returned value is discarded.
+                              TRY([[maybe_unused]] MirValue value,
+                                  this->buildFunctionCall(node));
+                              return Ok();
+                            },
+                            [&](const Return& node) {
+                              return this->buildReturn(node);
+                            }});
+  }
+
+  Result<None> buildVariableDeclaration(const VariableDeclaration& node) {
+    TRY(MirValue value, this->buildExpression(node.expression));
+    this->variables.set(node.name, value);
+    return Ok();
+  }
+
+  Result<None> buildReturn(const Return& node) {
+    MirValue value = NO_VALUE;
+    if (node.expression.has_value()) {
+      TRY(value, this->buildExpression(node.expression.value()));
+    }
+    this->endBlock(value);
+    return Ok();
+  }
+
+  // Ends the current block with a return of the value. main always returns an
+  // INT, so it returns 0 where it returns nothing.
+  void endBlock(MirValue value) {
+    MirFunction& function = *this->function;
+    if (value == NO_VALUE && function.returnType != BaseType::VOID) {
+      assert(function.name == Symbol::MAIN);
+      function.constants.push_back(
+          Constant{.type = BaseType::INT, .intValue = 0});
+      value = function.add(
+          MirInstruction{
+              .opcode = MirOpcode::NUMBER,
+              .type = BaseType::INT,
+              .immediate = (uint32_t)(function.constants.size() - 1)},
+          {});
+    }
+    function.blocks.back().returnValue = value;
+    this->isBlockEnded = true;
+  }
+
+  Result<MirValue> buildExpression(const Expression& node) {
+    return visit(*this->ast, node,
+                 Overloaded{[&](const VariableReference& node) {
+                              return Ok(*this->variables.get(node.name));
+                            },
+                            [&](const FunctionCall& node) {
+                              return this->buildFunctionCall(node);
+                            },
+                            [&](const NumberLiteral& node) {
+                              return this->buildNumberLiteral(node);
+                            },
+                            [&](const StringLiteral& node) {
+                              return this->buildStringLiteral(node);
+                            },
+                            [&](const BinaryExpression& node) {
+                              return this->buildBinaryExpression(node);
+                            }});
+  }
+
+  Result<MirValue> buildFunctionCall(const FunctionCall& node) {
+    size_t scratchStart = this->operandScratch.size();
+    for (const auto& arg : this->ast->get(node.args)) {
+      TRY(MirValue value, this->buildExpression(arg));
+      this->operandScratch.push_back(value);
+    }
+    Span<const MirValue> operands(this->operandScratch.data() + scratchStart,
+                                  this->operandScratch.size() - scratchStart);
+
+    MirInstruction instruction;
+    if (node.name == Symbol::FORK) {
+      instruction = MirInstruction{
+          .opcode = MirOpcode::FORK,
+          .isMove = node.isMove,
+          .type = this->function->instructions[operands[0]].type};
+    } else {
+      // Functions that aren't part of the program are builtins, which all
+      // return nothing.
+      const BaseType* returnType = this->returnTypes.get(node.name);
+      instruction = MirInstruction{
+          .opcode = MirOpcode::CALL,
+          .type = returnType != nullptr ? *returnType : BaseType::VOID,
+          .name = node.name};
+    }
+    MirValue value = this->function->add(instruction, operands);
+    this->operandScratch.resize(scratchStart);
+    return Ok(value);
+  }
+
+  Result<MirValue> buildNumberLiteral(const NumberLiteral& node) {
+    Constant constant =
+        node.constant.isKnown() ? node.constant : parseNumber(node.value);
+    assert(constant.isKnown());
+    this->function->constants.push_back(constant);
+    return Ok(this->function->add(
+        MirInstruction{
+            .opcode = MirOpcode::NUMBER,
+            .type = constant.type,
+            .immediate = (uint32_t)(this->function->constants.size() - 1)},
+        {}));
+  }
+
+  Result<MirValue> buildStringLiteral(const StringLiteral& node) {
+    this->function->strings.push_back(node.value);
+    return Ok(this->function->add(
+        MirInstruction{
+            .opcode = MirOpcode::STRING,
+            .type = BaseType::STRING,
+            .immediate = (uint32_t)(this->function->strings.size() - 1)},
+        {}));
+  }
+
+  Result<MirValue> buildBinaryExpression(const BinaryExpression& node) {
+    TRY(MirValue left, this->buildExpression(node.left));
+    TRY(MirValue right, this->buildExpression(node.right));
+    bool isArithmetic =
+        node.op == BinaryOperator::ADD || node.op == BinaryOperator::SUBTRACT;
+    // Comparisons result in an INT, like in C.
+    BaseType type = isArithmetic ? this->function->instructions[left].type
+                                 : BaseType::INT;
+    MirValue operands[] = {left, right};
+    return Ok(this->function->add(
+        MirInstruction{
+            .opcode = MirOpcode::BINARY, .op = node.op, .type = type},
+        operands));
+  }
+
+  Result<BaseType> getBaseType(const Type& type, Location loc) {
+    if (!type.isBaseType()) {
+      return Error("Type {} at {} can't be lowered to MIR yet.",
+                   type.toString(), loc);
+    }
+    return Ok(type.getBaseType());
+  }
+};
+
+#endif  // MIR_BUILDER_CC
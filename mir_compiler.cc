@@ -0,0 +1,147 @@
+#ifndef MIR_COMPILER_CC
+#define MIR_COMPILER_CC
+
+#include "builtins.cc"
+#include "compiler.cc"
+#include "mir.cc"
+#include "output_buffer.cc"
+
+// Lowers MIR to C. Each computed value becomes a local named _ followed by
+// its number, while parameters keep their names and constants are written
+// where they are used. Values are plain C values until heap types are
+// compiled, so a fork is just the value it forks.
+struct MirCompiler {
+  OutputBuffer out;
+  // Function being compiled.
+  const MirFunction* function;
+  // Whether each value of the function is used by an instruction or return.
+  Vector<bool> isUsed;
+
+  String compileProgram(const MirProgram& program) {
+    // Empty the output buffer in case this was called before.
+    this->out = OutputBuffer();
+    this->out.reserve(program.sourceSize * OUTPUT_SIZE_PER_SOURCE_BYTE);
+    for (const auto& include : program.includes) {
+      this->out.write("#include <");
+      this->out.write(include);
+      this->out.write(">\n");
+    }
+    if (program.includes.size() > 0) {
+      this->out.writeChar('\n');
+    }
+    for (size_t i = 0; i < program.functions.size(); i++) {
+      if (i > 0) {
+        this->out.write("\n\n");
+      }
+      this->compileFunction(program.functions[i]);
+    }
+    return this->out.take();
+  }
+
+  void compileFunction(const MirFunction& function) {
+    this->function = &function;
+    this->isUsed.assign(function.instructions.size(), false);
+    for (const auto& instruction : function.instructions) {
+      for (MirValue operand : function.getOperands(instruction)) {
+        this->isUsed[operand] = true;
+      }
+    }
+    for (const auto& block : function.blocks) {
+      if (block.returnValue != NO_VALUE) {
+        this->isUsed[block.returnValue] = true;
+      }
+    }
+
+    this->out.write(getCTypeName(function.returnType));
+    this->out.writeChar(' ');
+    this->out.write(symbolTable.getName(function.name));
+    this->out.writeChar('(');
+    for (uint32_t i = 0; i < function.paramCount; i++) {
+      const MirInstruction& param = function.instructions[i];
+      if (i > 0) {
+        this->out.write(", ");
+      }
+      this->out.write(getCTypeName(param.type));
+      this->out.writeChar(' ');
+      this->out.write(symbolTable.getName(param.name));
+    }
+    this->out.write(") {\n");
+    // Blocks after the first follow a return until the language has control
+    // flow, so they need no labels.
+    for (const auto& block : function.blocks) {
+      for (MirValue value = block.instructionStart;
+           value < block.instructionStart + block.instructionCount; value++) {
+        this->compileInstruction(value);
+      }
+      this->out.write("  return");
+      if (block.returnValue != NO_VALUE) {
+        this->out.writeChar(' ');
+        this->compileValue(block.returnValue);
+      }
+      this->out.write(";\n");
+    }
+    this->out.writeChar('}');
+  }
+
+  // Declares a local for the value if it's computed by a statement.
+  void compileInstruction(MirValue value) {
+    const MirInstruction& instruction = this->function->instructions[value];
+    Span<const MirValue> operands = this->function->getOperands(instruction);
+    if (instruction.opcode != MirOpcode::BINARY &&
+        instruction.opcode != MirOpcode::CALL) {
+      return;
+    }
+    this->out.writeIndent(INDENT_SIZE);
+    if (instruction.type != BaseType::VOID && this->isUsed[value]) {
+      this->out.write(getCTypeName(instruction.type));
+      this->out.write(" _");
+      this->out.writeInt(value);
+      this->out.write(" = ");
+    }
+    if (instruction.opcode == MirOpcode::BINARY) {
+      this->compileValue(operands[0]);
+      this->out.writeChar(' ');
+      this->out.write(binaryOperatorToString(instruction.op));
+      this->out.writeChar(' ');
+      this->compileValue(operands[1]);
+    } else {
+      this->out.write(symbolTable.getName(instruction.name));
+      this->out.writeChar('(');
+      for (size_t i = 0; i < operands.size(); i++) {
+        if (i > 0) {
+          this->out.write(", ");
+        }
+        this->compileValue(operands[i]);
+      }
+      this->out.writeChar(')');
+    }
+    this->out.write(";\n");
+  }
+
+  // Writes the C expression for a value used as an operand.
+  void compileValue(MirValue value) {
+    const MirInstruction& instruction = this->function->instructions[value];
+    switch (instruction.opcode) {
+      case MirOpcode::PARAM:
+        this->out.write(symbolTable.getName(instruction.name));
+        return;
+      case MirOpcode::NUMBER:
+        this->out.write(
+            this->function->constants[instruction.immediate].toString());
+        return;
+      case MirOpcode::STRING:
+        this->out.write(this->function->strings[instruction.immediate]);
+        return;
+      case MirOpcode::FORK:
+        this->compileValue(this->function->getOperands(instruction)[0]);
+        return;
+      case MirOpcode::BINARY:
+      case MirOpcode::CALL:
+        this->out.writeChar('_');
+        this->out.writeInt(value);
+        return;
+    }
+  }
+};
+
+#endif  // MIR_COMPILER_CC
@@ -0,0 +1,228 @@
+#ifndef MIR_PASSES_CC
+#define MIR_PASSES_CC
+
+#include <bit>
+
+#include "builtins.cc"
+#include "mir.cc"
+#include "mir_verifier.cc"
+#include "symbol_table.cc"
+
+// Whether the two instructions always compute the same value, with operands
+// already replaced by their earliest equivalent.
+bool isSameValue(const MirFunction& function, MirValue a, MirValue b) {
+  const MirInstruction& first = function.instructions[a];
+  const MirInstruction& second = function.instructions[b];
+  if (first.opcode != second.opcode || first.type != second.type) {
+    return false;
+  }
+  switch (first.opcode) {
+    case MirOpcode::NUMBER: {
+      const Constant& x = function.constants[first.immediate];
+      const Constant& y = function.constants[second.immediate];
+      // Compare floats bit for bit, since 0.0 and -0.0 are equal but are
+      // different values.
+      return x.type == BaseType::INT
+                 ? x.intValue == y.intValue
+                 : std::bit_cast<uint64_t>(x.floatValue) ==
+                       std::bit_cast<uint64_t>(y.floatValue);
+    }
+    case MirOpcode::STRING:
+      return function.strings[first.immediate] ==
+             function.strings[second.immediate];
+    case MirOpcode::BINARY: {
+      Span<const MirValue> x = function.getOperands(first);
+      Span<const MirValue> y = function.getOperands(second);
+      return first.op == second.op && x[0] == y[0] && x[1] == y[1];
+    }
+    default:
+      return false;
+  }
+}
+
+// Hash of what an instruction computes, equal for instructions isSameValue()
+// matches. Returns 0 for instructions that can't be shared: parameters are
+// all different, calls may have side effects, and each fork hands out a new
+// reference.
+uint32_t hashValue(const MirFunction& function, MirValue value) {
+  const MirInstruction& instruction = function.instructions[value];
+  uint32_t hash =
+      (uint32_t)instruction.opcode * 31 + (uint32_t)instruction.type;
+  switch (instruction.opcode) {
+    case MirOpcode::NUMBER: {
+      const Constant& constant = function.constants[instruction.immediate];
+      uint64_t bits = constant.type == BaseType::INT
+                          ? (uint64_t)constant.intValue
+                          : std::bit_cast<uint64_t>(constant.floatValue);
+      hash = hash * 31 + (uint32_t)(bits ^ (bits >> 32));
+      break;
+    }
+    case MirOpcode::STRING:
+      hash = hash * 31 +
+             SymbolTable::hashName(function.strings[instruction.immediate]);
+      break;
+    case MirOpcode::BINARY: {
+      Span<const MirValue> operands = function.getOperands(instruction);
+      hash = (hash * 31 + (uint32_t)instruction.op) * 31 + operands[0];
+      hash = hash * 31 + operands[1];
+      break;
+    }
+    default:
+      return 0;
+  }
+  // Keep 0 free to mean the instruction can't be shared.
+  return hash | 1;
+}
+
+// Makes instructions that compute the same value as an earlier one in their
+// block use the earlier one's value instead, leaving the later one unused for
+// eliminateDeadInstructions(). Returns the number of instructions replaced.
+size_t eliminateCommonSubexpressions(MirFunction& function) {
+  Vector<MirValue> replacements(function.instructions.size());
+  for (MirValue value = 0; value < replacements.size(); value++) {
+    replacements[value] = value;
+  }
+  size_t replacedCount = 0;
+  // Open addressing hash table of the values computed so far in the block,
+  // with NO_VALUE marking an empty slot.
+  Vector<MirValue> slots;
+  for (auto& block : function.blocks) {
+    slots.assign(std::bit_ceil(block.instructionCount * 2 + 1), NO_VALUE);
+    size_t mask = slots.size() - 1;
+    for (MirValue value = block.instructionStart;
+         value < block.instructionStart + block.instructionCount; value++) {
+      const MirInstruction& instruction = function.instructions[value];
+      for (uint32_t i = 0; i < instruction.operands.size(); i++) {
+        MirValue& operand = function.operands[instruction.operands.start + i];
+        operand = replacements[operand];
+      }
+      uint32_t hash = hashValue(function, value);
+      if (hash == 0) {
+        continue;
+      }
+      size_t slot = hash & mask;
+      while (slots[slot] != NO_VALUE &&
+             !isSameValue(function, slots[slot], value)) {
+        slot = (slot + 1) & mask;
+      }
+      if (slots[slot] == NO_VALUE) {
+        slots[slot] = value;
+      } else {
+        replacements[value] = slots[slot];
+        replacedCount++;
+      }
+    }
+    if (block.returnValue != NO_VALUE) {
+      block.returnValue = replacements[block.returnValue];
+    }
+  }
+  return replacedCount;
+}
+
+// Removes instructions whose value is never used and that have no effect
+// besides computing it, renumbering the rest. Calls are kept for their side
+// effects and parameters for the signature. Dropping an unused FORK elides
+// its refcount increment. Returns the number of instructions removed.
+size_t eliminateDeadInstructions(MirFunction& function) {
+  Vector<bool> isUsed(function.instructions.size());
+  for (const auto& block : function.blocks) {
+    if (block.returnValue != NO_VALUE) {
+      isUsed[block.returnValue] = true;
+    }
+  }
+  // Operands are always defined before their users, so walking backwards
+  // sees every use of a value before the value itself.
+  for (MirValue value = function.instructions.size(); value-- > 0;) {
+    const MirInstruction& instruction = function.instructions[value];
+    isUsed[value] = isUsed[value] || instruction.opcode == MirOpcode::CALL ||
+                    instruction.opcode == MirOpcode::PARAM;
+    if (isUsed[value]) {
+      for (MirValue operand : function.getOperands(instruction)) {
+        isUsed[operand] = true;
+      }
+    }
+  }
+
+  Vector<MirValue> newValues(function.instructions.size(), NO_VALUE);
+  Vector<MirInstruction> instructions;
+  Vector<MirValue> operands;
+  for (auto& block : function.blocks) {
+    uint32_t blockStart = instructions.size();
+    for (MirValue value = block.instructionStart;
+         value < block.instructionStart + block.instructionCount; value++) {
+      if (!isUsed[value]) {
+        continue;
+      }
+      MirInstruction instruction = function.instructions[value];
+      uint32_t operandStart = operands.size();
+      for (MirValue operand : function.getOperands(instruction)) {
+        operands.push_back(newValues[operand]);
+      }
+      instruction.operands.start = operandStart;
+      newValues[value] = instructions.size();
+      instructions.push_back(instruction);
+    }
+    block.instructionStart = blockStart;
+    block.instructionCount = instructions.size() - blockStart;
+    if (block.returnValue != NO_VALUE) {
+      block.returnValue = newValues[block.returnValue];
+    }
+  }
+  size_t removedCount = function.instructions.size() - instructions.size();
+  function.instructions = std::move(instructions);
+  function.operands = std::move(operands);
+  return removedCount;
+}
+
+// Pass that transforms one function at a time, returning the number of
+// instructions it changed.
+struct MirPass {
+  StringView name;
+  size_t (*run)(MirFunction& function);
+};
+
+// Runs passes over every function of a program in order.
+struct MirPassManager {
+  Vector<MirPass> passes;
+  // Whether to verify the program before the first pass and after each one,
+  // so a pass producing invalid MIR is named in the error.
+  bool verifyEachPass = true;
+  // Number of instructions each pass changed over the whole program.
+  Vector<size_t> changeCounts;
+
+  Result<None> run(MirProgram& program) {
+    this->changeCounts.assign(this->passes.size(), 0);
+    TRY(this->verify(program, "lowering"));
+    for (size_t i = 0; i < this->passes.size(); i++) {
+      for (auto& function : program.functions) {
+        this->changeCounts[i] += this->passes[i].run(function);
+      }
+      TRY(this->verify(program, this->passes[i].name));
+    }
+    return Ok();
+  }
+
+  Result<None> verify(const MirProgram& program, StringView lastStep) {
+    if (!this->verifyEachPass) {
+      return Ok();
+    }
+    Result<None> result = MirVerifier().verifyProgram(program);
+    if (!result.ok) {
+      return Error("Invalid MIR after {}. {}", lastStep, result.getError());
+    }
+    return Ok();
+  }
+};
+
+// Pass manager with the passes we run on every program, in order.
+MirPassManager createDefaultPassManager() {
+  return MirPassManager{
+      .passes = {
+          MirPass{.name = "eliminateCommonSubexpressions",
+                  .run = eliminateCommonSubexpressions},
+          MirPass{.name = "eliminateDeadInstructions",
+                  .run = eliminateDeadInstructions},
+      }};
+}
+
+#endif  // MIR_PASSES_CC
@@ -0,0 +1,112 @@
+#ifndef MIR_PRINTER_CC
+#define MIR_PRINTER_CC
+
+#include "builtins.cc"
+#include "mir.cc"
+#include "output_buffer.cc"
+
+// Prints MIR as text for spec tests and debugging, one instruction per line:
+//
+// fn add: INT
+// b0:
+//   %0: INT = param x
+//   %1: INT = 1
+//   %2: INT = %0 + %1
+//   return %2
+struct MirPrinter {
+  OutputBuffer out;
+
+  String printProgram(const MirProgram& program) {
+    // Empty the output buffer in case this was called before.
+    this->out = OutputBuffer();
+    for (size_t i = 0; i < program.functions.size(); i++) {
+      if (i > 0) {
+        this->out.writeChar('\n');
+      }
+      this->printFunction(program.functions[i]);
+    }
+    // Every function ends its last line, so drop the final newline.
+    String result = this->out.take();
+    if (!result.empty() && result.back() == '\n') {
+      result.pop_back();
+    }
+    return result;
+  }
+
+  void printFunction(const MirFunction& function) {
+    this->out.write("fn ");
+    this->out.write(symbolTable.getName(function.name));
+    this->out.write(": ");
+    this->out.write(baseTypeToString(function.returnType));
+    this->out.write(function.isExported ? " (pub)\n" : "\n");
+    for (size_t i = 0; i < function.blocks.size(); i++) {
+      const MirBlock& block = function.blocks[i];
+      this->out.writeChar('b');
+      this->out.writeInt(i);
+      this->out.write(":\n");
+      for (uint32_t value = block.instructionStart;
+           value < block.instructionStart + block.instructionCount; value++) {
+        this->out.writeIndent(2);
+        this->printInstruction(function, value);
+        this->out.writeChar('\n');
+      }
+      this->out.write("  return");
+      if (block.returnValue != NO_VALUE) {
+        this->out.writeChar(' ');
+        this->printValue(block.returnValue);
+      }
+      this->out.writeChar('\n');
+    }
+  }
+
+  void printValue(MirValue value) {
+    this->out.writeChar('%');
+    this->out.writeInt(value);
+  }
+
+  void printInstruction(const MirFunction& function, MirValue value) {
+    const MirInstruction& instruction = function.instructions[value];
+    Span<const MirValue> operands = function.getOperands(instruction);
+    this->printValue(value);
+    this->out.write(": ");
+    this->out.write(baseTypeToString(instruction.type));
+    this->out.write(" = ");
+    switch (instruction.opcode) {
+      case MirOpcode::PARAM:
+        this->out.write("param ");
+        this->out.write(symbolTable.getName(instruction.name));
+        return;
+      case MirOpcode::NUMBER:
+        this->out.write(function.constants[instruction.immediate].toString());
+        return;
+      case MirOpcode::STRING:
+        this->out.write(function.strings[instruction.immediate]);
+        return;
+      case MirOpcode::BINARY:
+        this->printValue(operands[0]);
+        this->out.writeChar(' ');
+        this->out.write(binaryOperatorToString(instruction.op));
+        this->out.writeChar(' ');
+        this->printValue(operands[1]);
+        return;
+      case MirOpcode::CALL:
+        this->out.write("call ");
+        this->out.write(symbolTable.getName(instruction.name));
+        this->out.writeChar('(');
+        for (size_t i = 0; i < operands.size(); i++) {
+          if (i > 0) {
+            this->out.write(", ");
+          }
+          this->printValue(operands[i]);
+        }
+        this->out.writeChar(')');
+        return;
+      case MirOpcode::FORK:
+        this->out.write(instruction.isMove ? "move " : "fork ");
+        this->printValue(operands[0]);
+        return;
+    }
+  }
+};
+
+#endif  // MIR_PRINTER_CC
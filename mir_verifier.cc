@@ -0,0 +1,220 @@
+#ifndef MIR_VERIFIER_CC
+#define MIR_VERIFIER_CC
+
+#include "builtins.cc"
+#include "mir.cc"
+#include "scoped_symbol_map.cc"
+
+// Checks that MIR is well formed, so a broken pass is caught right after it
+// runs rather than as wrong C later on. Blocks must cover the instructions in
+// order, values must be defined before they are used, and every instruction
+// and return must agree with the types of its operands and the signatures of
+// the functions it calls. Returns the first problem found.
+struct MirVerifier {
+  const MirProgram* program;
+  // Index of every function of the program.
+  ScopedSymbolMap<uint32_t> functions;
+
+  Result<None> verifyProgram(const MirProgram& program) {
+    this->program = &program;
+    this->functions = ScopedSymbolMap<uint32_t>();
+    for (uint32_t i = 0; i < program.functions.size(); i++) {
+      this->functions.set(program.functions[i].name, i);
+    }
+    for (const auto& function : program.functions) {
+      TRY(this->verifyFunction(function));
+    }
+    return Ok();
+  }
+
+  Result<None> verifyFunction(const MirFunction& function) {
+    StringView name = symbolTable.getName(function.name);
+    if (function.blocks.empty()) {
+      return Error("MIR of {} has no blocks.", name);
+    }
+    if (function.blocks[0].instructionCount < function.paramCount) {
+      return Error("MIR of {} has {} parameters outside its entry block.",
+                   name, function.paramCount);
+    }
+    uint32_t blockEnd = 0;
+    for (size_t i = 0; i < function.blocks.size(); i++) {
+      const MirBlock& block = function.blocks[i];
+      if (block.instructionStart != blockEnd) {
+        return Error("MIR of {} has b{} start at %{} instead of %{}.", name, i,
+                     block.instructionStart, blockEnd);
+      }
+      blockEnd += block.instructionCount;
+      if (blockEnd > function.instructions.size()) {
+        return Error("MIR of {} has b{} end past its instructions.", name, i);
+      }
+      for (MirValue value = block.instructionStart; value < blockEnd;
+           value++) {
+        TRY(this->verifyInstruction(function, value));
+      }
+      TRY(this->verifyReturn(function, i, blockEnd));
+    }
+    if (blockEnd != function.instructions.size()) {
+      return Error("MIR of {} has instructions from %{} outside any block.",
+                   name, blockEnd);
+    }
+    return Ok();
+  }
+
+  Result<None> verifyReturn(const MirFunction& function, size_t blockIndex,
+                            uint32_t blockEnd) {
+    StringView name = symbolTable.getName(function.name);
+    MirValue value = function.blocks[blockIndex].returnValue;
+    if (value == NO_VALUE) {
+      if (function.returnType != BaseType::VOID) {
+        return Error("MIR of {} returns nothing from b{} but must return {}.",
+                     name, blockIndex, baseTypeToString(function.returnType));
+      }
+      return Ok();
+    }
+    if (value >= blockEnd) {
+      return Error("MIR of {} returns %{} from b{} before it's defined.", name,
+                   value, blockIndex);
+    }
+    if (function.instructions[value].type != function.returnType) {
+      return Error("MIR of {} returns %{} of type {} but must return {}.",
+                   name, value,
+                   baseTypeToString(function.instructions[value].type),
+                   baseTypeToString(function.returnType));
+    }
+    return Ok();
+  }
+
+  Result<None> verifyInstruction(const MirFunction& function,
+                                 MirValue value) {
+    StringView name = symbolTable.getName(function.name);
+    const MirInstruction& instruction = function.instructions[value];
+    Span<const MirValue> operands = function.getOperands(instruction);
+    size_t operandCount = 0;
+    switch (instruction.opcode) {
+      case MirOpcode::PARAM:
+      case MirOpcode::NUMBER:
+      case MirOpcode::STRING:
+        operandCount = 0;
+        break;
+      case MirOpcode::BINARY:
+        operandCount = 2;
+        break;
+      case MirOpcode::FORK:
+        operandCount = 1;
+        break;
+      case MirOpcode::CALL:
+        operandCount = operands.size();
+        break;
+    }
+    if (operands.size() != operandCount) {
+      return Error("MIR of {} has {} %{} with {} operands instead of {}.",
+                   name, mirOpcodeToString(instruction.opcode), value,
+                   operands.size(), operandCount);
+    }
+    for (MirValue operand : operands) {
+      if (operand >= value) {
+        return Error("MIR of {} has %{} use %{} before it's defined.", name,
+                     value, operand);
+      }
+      if (function.instructions[operand].type == BaseType::VOID) {
+        return Error("MIR of {} has %{} use %{}, which has no value.", name,
+                     value, operand);
+      }
+    }
+
+    Optional<BaseType> expectedType;
+    switch (instruction.opcode) {
+      case MirOpcode::PARAM:
+        if (value >= function.paramCount || instruction.immediate != value) {
+          return Error("MIR of {} has a PARAM %{} that isn't parameter {}.",
+                       name, value, value);
+        }
+        expectedType = instruction.type;
+        break;
+      case MirOpcode::NUMBER:
+        if (instruction.immediate >= function.constants.size()) {
+          return Error("MIR of {} has NUMBER %{} use a missing constant.",
+                       name, value);
+        }
+        expectedType = function.constants[instruction.immediate].type;
+        break;
+      case MirOpcode::STRING:
+        if (instruction.immediate >= function.strings.size()) {
+          return Error("MIR of {} has STRING %{} use a missing string.", name,
+                       value);
+        }
+        expectedType = BaseType::STRING;
+        break;
+      case MirOpcode::BINARY: {
+        BaseType left = function.instructions[operands[0]].type;
+        BaseType right = function.instructions[operands[1]].type;
+        if (left != right ||
+            (left != BaseType::INT && left != BaseType::FLOAT)) {
+          return Error("MIR of {} has %{} apply {} to {} and {}.", name, value,
+                       binaryOperatorToString(instruction.op),
+                       baseTypeToString(left), baseTypeToString(right));
+        }
+        bool isArithmetic = instruction.op == BinaryOperator::ADD ||
+                            instruction.op == BinaryOperator::SUBTRACT;
+        expectedType = isArithmetic ? left : BaseType::INT;
+        break;
+      }
+      case MirOpcode::CALL: {
+        TRY(expectedType, this->verifyCall(function, value));
+        break;
+      }
+      case MirOpcode::FORK:
+        expectedType = function.instructions[operands[0]].type;
+        break;
+    }
+    if (value < function.paramCount &&
+        instruction.opcode != MirOpcode::PARAM) {
+      return Error("MIR of {} has {} %{} in place of a PARAM.", name,
+                   mirOpcodeToString(instruction.opcode), value);
+    }
+    if (instruction.type != expectedType) {
+      return Error("MIR of {} has {} %{} of type {} instead of {}.", name,
+                   mirOpcodeToString(instruction.opcode), value,
+                   baseTypeToString(instruction.type),
+                   baseTypeToString(expectedType.value()));
+    }
+    return Ok();
+  }
+
+  // Checks the arguments of the call, returning the type of its result.
+  Result<BaseType> verifyCall(const MirFunction& function, MirValue value) {
+    StringView name = symbolTable.getName(function.name);
+    const MirInstruction& instruction = function.instructions[value];
+    Span<const MirValue> operands = function.getOperands(instruction);
+    StringView calleeName = symbolTable.getName(instruction.name);
+    const uint32_t* calleeIndex = this->functions.get(instruction.name);
+    if (calleeIndex == nullptr) {
+      if (instruction.name != Symbol::PRINTLN || operands.size() != 1 ||
+          function.instructions[operands[0]].type != BaseType::STRING) {
+        return Error("MIR of {} has %{} call unknown function {}.", name,
+                     value, calleeName);
+      }
+      return Ok(BaseType::VOID);
+    }
+
+    const MirFunction& callee = this->program->functions[*calleeIndex];
+    if (operands.size() != callee.paramCount) {
+      return Error("MIR of {} has %{} call {} with {} arguments instead of {}.",
+                   name, value, calleeName, operands.size(),
+                   callee.paramCount);
+    }
+    for (uint32_t i = 0; i < operands.size(); i++) {
+      BaseType argType = function.instructions[operands[i]].type;
+      BaseType paramType = callee.instructions[i].type;
+      if (argType != paramType) {
+        return Error("MIR of {} has %{} pass {} as argument {} of {}, which "
+                     "takes {}.",
+                     name, value, baseTypeToString(argType), i + 1,
+                     calleeName, baseTypeToString(paramType));
+      }
+    }
+    return Ok(callee.returnType);
+  }
+};
+
+#endif  // MIR_VERIFIER_CC
@@ -2,18 +2,42 @@
 #define NUO_CC
 
 /*
-Run code:
+Run tests:
 clang++ -Wextra -Werror -std=c++20 nuo.cc -o build/nuo && ./build/nuo
+
+Run a program with the bytecode VM:
+./build/nuo run program.nuo
+
+Compile a program to a header and 4 .c files in the build directory:
+./build/nuo split program.nuo build 4
+
+Either can list which calls were inlined first:
+./build/nuo --report-inlining run program.nuo
 */
+#include <sys/stat.h>
+
 #include "analyzer.cc"
 #include "ast.cc"
 #include "ast_printer.cc"
 #include "builtins.cc"
+#include "bytecode_compiler.cc"
 #include "compiler.cc"
+#include "constant_folding.cc"
+#include "dead_function_elimination.cc"
+#include "escape_analysis.cc"
 #include "file.cc"
+#include "inliner.cc"
+#include "mir_builder.cc"
+#include "mir_compiler.cc"
+#include "mir_passes.cc"
+#include "mir_printer.cc"
+#include "parallel_tokenizer.cc"
 #include "parser.cc"
 #include "spec_test.cc"
+#include "split_compiler.cc"
+#include "thread_pool.cc"
 #include "tokenizer.cc"
+#include "vm.cc"
 
 Result<String> getActualResultForTokenizerTest(const TestCase& testCase) {
   StringStream result;
@@ -29,6 +53,21 @@ Result<String> getActualResultForTokenizerTest(const TestCase& testCase) {
   return Ok(result.str());
 }
 
+// Tokenizes with as many chunks as possible, to check that splitting the code
+// never changes the tokens.
+Result<String> getActualResultForParallelTokenizerTest(
+    const TestCase& testCase) {
+  StringStream result;
+  TRY(TokenBuffer tokens, tokenizeParallel(testCase.input, 4, 1));
+  for (size_t i = 0; i < tokens.size(); i++) {
+    result << tokens.get(i).toString(testCase.input);
+    if (i < tokens.size() - 1) {
+      result << '\n';
+    }
+  }
+  return Ok(result.str());
+}
+
 Result<String> getActualResultForParserTest(const TestCase& testCase) {
   // Parse code.
   Parser parser(testCase.input);
@@ -39,39 +78,302 @@ Result<String> getActualResultForParserTest(const TestCase& testCase) {
   return Ok(astString);
 }
 
-Result<String> getActualResultForCompilerTest(const TestCase& testCase) {
-  // Parse code.
-  Parser parser(testCase.input);
+// Parses and analyzes the source, which every pipeline after the parser
+// starts with.
+Result<Program> parseAndAnalyze(StringView source,
+                                ThreadPool* threadPool = nullptr) {
+  Parser parser(source);
   TRY(Program program, parser.parse());
-  // Analyze code.
-  Analyzer analyzer;
+  Analyzer analyzer = {.threadPool = threadPool};
   TRY(analyzer.analyzeProgram(program));
-  // Compile code.
+  return Ok(std::move(program));
+}
+
+// Lists the warnings of the program before its compiled code, so tests cover
+// both.
+String addWarnings(const Program& program, const String& compiledProgram) {
+  String result;
+  for (ErrorId warning : program.warnings) {
+    result += "Warning: " + getDiagnostics().getMessage(warning) + "\n";
+  }
+  if (!result.empty()) {
+    result += "\n";
+  }
+  return result + compiledProgram;
+}
+
+Result<String> getActualResultForCompilerTest(const TestCase& testCase) {
+  TRY(Program program, parseAndAnalyze(testCase.input));
+  eliminateDeadFunctions(program);
+  Compiler compiler;
+  TRY(String compiledProgram, compiler.compileProgram(program));
+  return Ok(addWarnings(program, compiledProgram));
+}
+
+// Streams the output through a tiny buffer, to check that flushing it as it
+// fills never changes the output.
+Result<String> streamCompiledProgram(const TestCase& testCase,
+                                     ThreadPool* threadPool) {
+  TRY(Program program, parseAndAnalyze(testCase.input));
+  eliminateDeadFunctions(program);
+  const char* fileName = "build/streamed.c";
+  TRY(int fd, createFile(fileName));
+  Compiler compiler = {.threadPool = threadPool};
+  Result<None> result = compiler.compileProgramToFile(program, fd, 16);
+  close(fd);
+  TRY(result);
+  TRY(String compiledProgram, readFile(fileName));
+  return Ok(addWarnings(program, compiledProgram));
+}
+
+Result<String> getActualResultForStreamingCompilerTest(
+    const TestCase& testCase) {
+  return streamCompiledProgram(testCase, nullptr);
+}
+
+// Streams the output while compiling a window of functions at a time on
+// several threads.
+Result<String> getActualResultForParallelStreamingCompilerTest(
+    const TestCase& testCase) {
+  static ThreadPool threadPool(4);
+  return streamCompiledProgram(testCase, &threadPool);
+}
+
+// Analyzes and compiles on several threads, to check that splitting the
+// functions between threads never changes the output or which error is
+// reported.
+Result<String> getActualResultForParallelCompilerTest(
+    const TestCase& testCase) {
+  static ThreadPool threadPool(4);
+  TRY(Program program, parseAndAnalyze(testCase.input, &threadPool));
+  eliminateDeadFunctions(program);
+  Compiler compiler = {.threadPool = &threadPool};
+  TRY(String compiledProgram, compiler.compileProgram(program));
+  return Ok(addWarnings(program, compiledProgram));
+}
+
+Result<String> getActualResultForConstantFoldingTest(const TestCase& testCase) {
+  TRY(Program program, parseAndAnalyze(testCase.input));
+  eliminateDeadFunctions(program);
+  ConstantFolder constantFolder;
+  constantFolder.foldProgram(program);
   Compiler compiler;
   TRY(String compiledProgram, compiler.compileProgram(program));
   return Ok(compiledProgram);
 }
 
+// Lists whether each allocation escapes its function.
+Result<String> getActualResultForEscapeAnalysisTest(const TestCase& testCase) {
+  TRY(Program program, parseAndAnalyze(testCase.input));
+  EscapeAnalyzer escapeAnalyzer;
+  escapeAnalyzer.analyzeProgram(program);
+  StringStream result;
+  for (const auto& allocation : escapeAnalyzer.allocations) {
+    result << symbolTable.getName(allocation.function) << ": "
+           << symbolTable.getName(allocation.declaration->name)
+           << (allocation.declaration->isOnStack ? " stays on the stack\n"
+                                                 : " escapes\n");
+  }
+  result << "Promoted " << escapeAnalyzer.promotedCount << " of "
+         << escapeAnalyzer.allocations.size() << " allocations.";
+  return Ok(result.str());
+}
+
+// Lists the inlining decisions before the compiled code.
+Result<String> getActualResultForInlinerTest(const TestCase& testCase) {
+  TRY(Program program, parseAndAnalyze(testCase.input));
+  Inliner inliner = {.reportDecisions = true};
+  inliner.inlineProgram(program);
+  eliminateDeadFunctions(program);
+  Compiler compiler;
+  TRY(String compiledProgram, compiler.compileProgram(program));
+  String result;
+  for (const auto& decision : inliner.decisions) {
+    result += decision + "\n";
+  }
+  return Ok(result + "\n" + compiledProgram);
+}
+
+// Prints the MIR after the default passes, followed by the C emitted from it.
+Result<String> getActualResultForMirTest(const TestCase& testCase) {
+  TRY(Program program, parseAndAnalyze(testCase.input));
+  eliminateDeadFunctions(program);
+  MirBuilder builder;
+  TRY(MirProgram mir, builder.buildProgram(program));
+  TRY(createDefaultPassManager().run(mir));
+  return Ok(MirPrinter().printProgram(mir) + "\n\n" +
+            MirCompiler().compileProgram(mir));
+}
+
+// Prints every file of the program split into two translation units.
+Result<String> getActualResultForSplitCompilerTest(const TestCase& testCase) {
+  TRY(Program program, parseAndAnalyze(testCase.input));
+  eliminateDeadFunctions(program);
+  SplitCompiler compiler = {.baseName = "program", .unitCount = 2};
+  TRY(Vector<OutputFile> files, compiler.compileProgram(program));
+  String result;
+  for (const auto& file : files) {
+    result += (result.empty() ? "// " : "\n// ") + file.name + "\n" + file.text;
+  }
+  return Ok(result);
+}
+
+// Optimizes the analyzed program the same way for every output. Calls to
+// small functions are inlined first, so constants passed to them are folded
+// with the rest. Inlining leaves some functions uncalled, so dead functions
+// are removed last. Prints every inlining decision if asked.
+void optimizeProgram(Program& program, bool reportInlining) {
+  Inliner inliner = {.reportDecisions = reportInlining};
+  inliner.inlineProgram(program);
+  for (const auto& decision : inliner.decisions) {
+    print(decision);
+  }
+  ConstantFolder constantFolder;
+  constantFolder.foldProgram(program);
+  eliminateDeadFunctions(program);
+}
+
+// Lowers the program to bytecode the Vm can run.
+Result<BytecodeProgram> compileToBytecode(StringView source,
+                                          bool reportInlining) {
+  TRY(Program program, parseAndAnalyze(source));
+  optimizeProgram(program, reportInlining);
+  MirBuilder builder;
+  TRY(MirProgram mir, builder.buildProgram(program));
+  TRY(createDefaultPassManager().run(mir));
+  BytecodeCompiler compiler;
+  return compiler.compileProgram(mir);
+}
+
+// Prints what the program prints when run by the Vm, followed by what main
+// returned.
+Result<String> getActualResultForVmTest(const TestCase& testCase) {
+  TRY(BytecodeProgram program, compileToBytecode(testCase.input, false));
+  OutputBuffer out;
+  Vm vm;
+  TRY(int64_t exitCode, vm.run(program, out));
+  return Ok(out.take() + std::format("Exited with {}.", exitCode));
+}
+
 struct FailedTest {
-  StringView testFileName;
+  String testName;
   Optional<String> error;
 };
 
-int main() {
+// Runs the program in the file with the Vm, without generating C, and exits
+// with what main returns.
+int runFile(StringView fileName, bool reportInlining) {
+  Result<String> source = readFile(fileName);
+  if (!source.ok) {
+    print(source.getError());
+    return 1;
+  }
+  Result<BytecodeProgram> program =
+      compileToBytecode(source.value, reportInlining);
+  if (!program.ok) {
+    print(program.getError());
+    return 1;
+  }
+  OutputBuffer out = OutputBuffer::toFile(STDOUT_FILENO);
+  // Someone may be reading a terminal or pipe as lines come, while a file is
+  // only read once the program is done.
+  struct stat output;
+  bool isFile = fstat(STDOUT_FILENO, &output) == 0 && S_ISREG(output.st_mode);
+  Vm vm = {.flushEachLine = !isFile};
+  Result<int64_t> exitCode = vm.run(program.value, out);
+  Result<None> writeResult = out.finish();
+  if (!exitCode.ok || !writeResult.ok) {
+    print(exitCode.ok ? writeResult.getError() : exitCode.getError());
+    return 1;
+  }
+  return (int)exitCode.value;
+}
+
+// Compiles the program in the file to a header, the given number of .c files
+// and a manifest listing them, all written to the directory. The files are
+// named after the program's file.
+Result<None> splitFile(StringView fileName, StringView directory,
+                       StringView unitCountText, bool reportInlining) {
+  size_t unitCount = 0;
+  const char* end = unitCountText.data() + unitCountText.size();
+  auto [ptr, error] = std::from_chars(unitCountText.data(), end, unitCount);
+  if (error != std::errc() || ptr != end || unitCount == 0) {
+    return Error("Number of files {} must be a positive number.",
+                 unitCountText);
+  }
+  TRY(String source, readFile(fileName));
+  TRY(Program program, parseAndAnalyze(source));
+  optimizeProgram(program, reportInlining);
+
+  // Name the files after the program's file, without its directory and
+  // extension.
+  StringView baseName = fileName.substr(fileName.rfind('/') + 1);
+  baseName = baseName.substr(0, baseName.rfind('.'));
+  SplitCompiler compiler = {.baseName = String(baseName),
+                            .unitCount = unitCount};
+  TRY(Vector<OutputFile> files, compiler.compileProgram(program));
+  return writeOutputFiles(directory, files);
+}
+
+int main(int argc, char** argv) {
+  DiagnosticsScope diagnosticsScope;
+  // Flags can come anywhere after the command's name.
+  bool reportInlining = false;
+  Vector<StringView> args;
+  for (int i = 1; i < argc; i++) {
+    if (StringView(argv[i]) == "--report-inlining") {
+      reportInlining = true;
+    } else {
+      args.push_back(argv[i]);
+    }
+  }
+  if (args.size() == 2 && args[0] == "run") {
+    return runFile(args[1], reportInlining);
+  }
+  if (args.size() == 4 && args[0] == "split") {
+    Result<None> result = splitFile(args[1], args[2], args[3], reportInlining);
+    if (!result.ok) {
+      print(result.getError());
+      return 1;
+    }
+    return 0;
+  }
+  if (argc > 1) {
+    print(
+        "Usage: {} [--report-inlining] [run <file> | split <file> <directory> "
+        "<file count>]",
+        argv[0]);
+    return 1;
+  }
+
   Vector<SpecTest> tests = {
       SpecTest("tokenizer.test", getActualResultForTokenizerTest),
+      SpecTest("tokenizer.test", getActualResultForParallelTokenizerTest,
+               "parallel"),
       SpecTest("parser.test", getActualResultForParserTest),
       SpecTest("compiler.test", getActualResultForCompilerTest),
+      SpecTest("compiler.test", getActualResultForParallelCompilerTest,
+               "parallel"),
+      SpecTest("compiler.test", getActualResultForStreamingCompilerTest,
+               "streaming"),
+      SpecTest("compiler.test", getActualResultForParallelStreamingCompilerTest,
+               "parallel_streaming"),
+      SpecTest("constant_folding.test", getActualResultForConstantFoldingTest),
+      SpecTest("escape_analysis.test", getActualResultForEscapeAnalysisTest),
+      SpecTest("inliner.test", getActualResultForInlinerTest),
+      SpecTest("mir.test", getActualResultForMirTest),
+      SpecTest("split_compiler.test", getActualResultForSplitCompilerTest),
+      SpecTest("vm.test", getActualResultForVmTest),
   };
 
   Vector<FailedTest> failedTests;
   for (auto& test : tests) {
     Result<bool> testResult = test.run();
     if (!testResult.ok) {
-      failedTests.push_back((FailedTest){.testFileName = test.testFileName,
-                                         .error = testResult.error});
+      failedTests.push_back((FailedTest){.testName = test.getName(),
+                                         .error = testResult.getError()});
     } else if (!testResult.value) {
-      failedTests.push_back((FailedTest){.testFileName = test.testFileName,
+      failedTests.push_back((FailedTest){.testName = test.getName(),
                                          .error = std::nullopt});
     }
   }
@@ -82,10 +384,10 @@ int main() {
     print("The following tests failed:");
     for (const auto& failedTest : failedTests) {
       if (failedTest.error.has_value()) {
-        print("{} had an unexpected error:\n{}", failedTest.testFileName,
+        print("{} had an unexpected error:\n{}", failedTest.testName,
               failedTest.error.value());
       } else {
-        print("{}", failedTest.testFileName);
+        print("{}", failedTest.testName);
       }
     }
   }
@@ -0,0 +1,123 @@
+#ifndef OUTPUT_BUFFER_CC
+#define OUTPUT_BUFFER_CC
+
+#include <charconv>
+
+#include "builtins.cc"
+#include "file.cc"
+
+// Bytes an OutputBuffer streaming to a file holds before writing them out.
+const size_t STREAM_BUFFER_SIZE = 256 * 1024;
+
+// Append-only buffer for generated text. Writes are plain copies into a
+// string reserved up front, without the formatting and virtual calls of a
+// StringStream.
+//
+// By default all of the text is kept in memory and handed over without
+// copying it. A buffer made by toFile() instead streams to a file descriptor,
+// so generating any amount of text takes no more memory than the buffer.
+struct OutputBuffer {
+  // Spaces copied by writeIndent(), which writes longer indents in chunks.
+  static constexpr StringView SPACES =
+      "                                                                ";
+
+  String text;
+  // File descriptor the text is written to whenever it would grow past
+  // flushSize, or -1 to keep all of it.
+  int fd = -1;
+  size_t flushSize = SIZE_MAX;
+  // Bytes already written to the file.
+  size_t flushedSize = 0;
+  // First error writing to the file. Later output is dropped, since the file
+  // is incomplete anyway.
+  Optional<ErrorId> writeError;
+
+  // Creates a buffer that streams to the file descriptor, holding at most
+  // bufferSize bytes at a time.
+  static OutputBuffer toFile(int fd, size_t bufferSize = STREAM_BUFFER_SIZE) {
+    OutputBuffer buffer = {.fd = fd, .flushSize = bufferSize};
+    buffer.reserve(bufferSize);
+    return buffer;
+  }
+
+  // Reserves room for the given number of bytes, so a good estimate of the
+  // output size means the text is never copied while growing.
+  void reserve(size_t capacity) { this->text.reserve(capacity); }
+
+  void write(StringView text) {
+    if (this->text.size() + text.size() > this->flushSize) [[unlikely]] {
+      // Write the text along with the buffer rather than copying it in, so
+      // text longer than the buffer needs no room in it.
+      this->flush(text);
+      return;
+    }
+    this->text.append(text);
+  }
+
+  void writeChar(char c) {
+    if (this->text.size() >= this->flushSize) [[unlikely]] {
+      this->flush();
+    }
+    this->text.push_back(c);
+  }
+
+  void writeIndent(size_t count) {
+    while (count > SPACES.size()) {
+      this->write(SPACES);
+      count -= SPACES.size();
+    }
+    this->write(SPACES.substr(0, count));
+  }
+
+  void writeInt(int64_t value) {
+    char digits[20];
+    auto [end, error] = std::to_chars(digits, digits + sizeof(digits), value);
+    this->write(StringView(digits, end - digits));
+  }
+
+  // Bytes written so far, including those already written to the file.
+  size_t size() const { return this->flushedSize + this->text.size(); }
+
+  // Hands over the text written so far, leaving the buffer empty.
+  String take() {
+    String result = std::move(this->text);
+    this->text = String();
+    return result;
+  }
+
+  // Writes the buffered text to the file, followed by the given text, in a
+  // single writev() where possible. Does nothing for a buffer without a file.
+  void flush(StringView extra = {}) {
+    if (this->fd < 0) {
+      this->text.append(extra);
+      return;
+    }
+    if (!this->writeError.has_value()) {
+      iovec pieces[] = {
+          {.iov_base = this->text.data(), .iov_len = this->text.size()},
+          {.iov_base = (void*)extra.data(), .iov_len = extra.size()}};
+      Result<None> result = writeAll(this->fd, pieces);
+      if (!result.ok) {
+        this->writeError = result.error;
+      }
+    }
+    this->flushedSize += this->text.size() + extra.size();
+    this->text.clear();
+  }
+
+  // Writes out any buffered text, returning the first error writing to the
+  // file.
+  Result<None> finish() {
+    this->flush();
+    if (this->writeError.has_value()) {
+      return Error(this->writeError.value());
+    }
+    return Ok();
+  }
+};
+
+// Bytes of C generated per byte of Nuo source, rounded up, for sizing output
+// buffers from the source size.
+const size_t OUTPUT_SIZE_PER_SOURCE_BYTE = 2;
+
+#endif  // OUTPUT_BUFFER_CC
@@ -0,0 +1,100 @@
+#ifndef PARALLEL_TOKENIZER_CC
+#define PARALLEL_TOKENIZER_CC
+
+#include <thread>
+
+#include "builtins.cc"
+#include "scan.cc"
+#include "tokenizer.cc"
+
+// Finds where to split the code into roughly equal chunks that can be
+// tokenized independently. A chunk may only start right after a newline that
+// is outside of any string literal or parenthesis, since the tokenizer treats
+// newlines differently in those places. We find them with a pre-scan that only
+// stops at quotes, parenthesis and newlines, tracking the same state as the
+// tokenizer does.
+Vector<size_t> findChunkStarts(StringView code, size_t chunkCount) {
+  Vector<size_t> chunkStarts = {0};
+  size_t targetSize = code.length() / chunkCount;
+  bool inString = false;
+  // Mirrors Tokenizer::openParenCount, including how it wraps around on an
+  // unbalanced closing parenthesis.
+  size_t openParenCount = 0;
+  size_t index = 0;
+  while (chunkStarts.size() < chunkCount) {
+    index = scan<UnstructuredClass>(code, index);
+    if (index >= code.length()) {
+      break;
+    }
+    char c = code[index];
+    index++;
+    if (c == '"') {
+      inString = !inString;
+    } else if (inString) {
+      continue;
+    } else if (c == '(') {
+      openParenCount++;
+    } else if (c == ')') {
+      openParenCount--;
+    } else if (c == '\n' && openParenCount == 0 &&
+               index >= chunkStarts.back() + targetSize &&
+               index < code.length()) {
+      chunkStarts.push_back(index);
+    }
+  }
+  return chunkStarts;
+}
+
+// Tokenizes the code on multiple threads, producing exactly the same tokens as
+// Tokenizer::tokenize(). Code that is too small to be worth splitting, or that
+// fails to tokenize, is tokenized serially so that errors are reported the
+// same way.
+Result<TokenBuffer> tokenizeParallel(StringView code, size_t threadCount,
+                                     size_t minChunkSize = 1 << 20) {
+  size_t chunkCount =
+      std::min(threadCount, code.length() / std::max<size_t>(minChunkSize, 1));
+  if (chunkCount <= 1 || code.length() > MAX_SOURCE_SIZE) {
+    return Tokenizer(code).tokenize();
+  }
+
+  Vector<size_t> chunkStarts = findChunkStarts(code, chunkCount);
+  chunkStarts.push_back(code.length());
+  chunkCount = chunkStarts.size() - 1;
+
+  // Tokenize every chunk on its own thread.
+  Vector<Optional<Result<TokenBuffer>>> chunkTokens(chunkCount);
+  Vector<std::thread> threads;
+  Diagnostics* diagnostics = currentDiagnostics;
+  for (size_t i = 0; i < chunkCount; i++) {
+    threads.emplace_back([&, i]() {
+      currentDiagnostics = diagnostics;
+      StringView chunk =
+          code.substr(chunkStarts[i], chunkStarts[i + 1] - chunkStarts[i]);
+      chunkTokens[i] = Tokenizer(chunk).tokenize();
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+
+  size_t tokenCount = 1;
+  for (const auto& result : chunkTokens) {
+    if (!result->ok) {
+      return Tokenizer(code).tokenize();
+    }
+    tokenCount += result->value.size() - 1;
+  }
+
+  // Concatenate the tokens, leaving out the END token of every chunk but the
+  // last one.
+  TokenBuffer tokens(code);
+  tokens.reserve(tokenCount);
+  for (size_t i = 0; i < chunkCount; i++) {
+    const TokenBuffer& chunk = chunkTokens[i]->value;
+    size_t count = i < chunkCount - 1 ? chunk.size() - 1 : chunk.size();
+    tokens.append(chunk, count, chunkStarts[i]);
+  }
+  return Ok(std::move(tokens));
+}
+
+#endif  // PARALLEL_TOKENIZER_CC
@@ -5,117 +5,217 @@
 #include "builtins.cc"
 #include "tokenizer.cc"
 
+// Binary operator and precedence of each token type, indexed by token type.
+// Tokens that aren't binary operators have a precedence of 0.
+struct BinaryOperatorTable {
+  struct Entry {
+    BinaryOperator op;
+    int precedence;
+  };
+  Entry entries[256];
+
+  static constexpr BinaryOperatorTable make() {
+    BinaryOperatorTable table = {};
+#define BINARY_OPERATOR_TABLE_GENERATOR(OPERATOR, TOKEN, TEXT, PRECEDENCE) \
+  table.entries[static_cast<uint8_t>(TokenType::TOKEN)] =                  \
+      Entry{.op = BinaryOperator::OPERATOR, .precedence = PRECEDENCE};
+    FOREACH_BINARY_OPERATOR(BINARY_OPERATOR_TABLE_GENERATOR)
+    return table;
+  }
+
+  constexpr const Entry& get(TokenType type) const {
+    return this->entries[static_cast<uint8_t>(type)];
+  }
+};
+static constexpr BinaryOperatorTable binaryOperatorTable =
+    BinaryOperatorTable::make();
+
+// Deepest an expression can nest, counting binary operators and function
+// calls. The parser doesn't recurse for operators, but every pass after it
+// walks expressions recursively, so deeper ones are rejected here rather than
+// overflowing the native stack later.
+const uint32_t MAX_EXPRESSION_DEPTH = 10000;
+
+// Parsed operand of an expression, along with how deep it nests.
+struct Operand {
+  Expression expression;
+  uint32_t depth;
+};
+
+// Operator waiting for its right operand while parsing an expression. Open
+// parentheses are kept on the same stack with a precedence of 0.
+struct PendingOperator {
+  BinaryOperator op;
+  int precedence;
+  Location location;
+};
+
 struct Parser {
   StringView code;
   Tokenizer tokenizer;
-  Token currentToken;
+  // Tokens of the whole file, walked by index.
+  TokenBuffer tokens;
+  // Index of the current token.
+  size_t index = 0;
+  // Storage for the nodes of the program being parsed, handed over to the
+  // Program once parsing succeeds.
+  Ast ast;
+  // Child lists that are still being parsed. Nested lists are pushed on top of
+  // their parent's, and each list is moved into the Ast once it's complete.
+  Vector<Statement> statementScratch;
+  Vector<Expression> expressionScratch;
+  Vector<FunctionParameter> parameterScratch;
+  // Operands and pending operators of the expressions being parsed. Nested
+  // expressions, like function call arguments, are pushed on top of the
+  // enclosing expression's.
+  Vector<Operand> operandStack;
+  Vector<PendingOperator> operatorStack;
+  // Depth of the expression or operand parsed last.
+  uint32_t expressionDepth = 0;
+  // Function calls whose arguments are being parsed, which the parser
+  // recurses for.
+  uint32_t callDepth = 0;
 
   Parser(StringView code) : code(code), tokenizer(Tokenizer(code)) {}
 
   Result<Program> parse() {
-    // Populate current token before parsing the program.
-    TRY(this->currentToken, this->tokenizer.next());
+    // Tokenize the whole file before parsing the program.
+    TRY(this->tokens, this->tokenizer.tokenize());
+    this->index = 0;
 
     Vector<FunctionDeclaration> functions;
     while (!this->isToken(TokenType::END)) {
       // Consume any preceding or trailing newlines.
       if (this->isToken(TokenType::NEWLINE)) {
-        TRY(this->consumeToken());
-      } else if (this->isToken(TokenType::FN)) {
+        this->consumeToken();
+      } else {
         TRY(FunctionDeclaration function, this->parseFunctionDeclaration());
         functions.push_back(std::move(function));
       }
     }
 
-    return Ok(Program{.functions = std::move(functions)});
+    this->ast.shrinkToFit();
+    return Ok(Program{.functions = std::move(functions),
+                      .ast = std::move(this->ast),
+                      .sourceSize = this->code.size()});
+  }
+
+  // Returns the type of the token k tokens after the current one, or END if
+  // that's past the end of the file.
+  TokenType peek(size_t k) {
+    size_t peekIndex = this->index + k;
+    if (peekIndex >= this->tokens.size()) {
+      return TokenType::END;
+    }
+    return this->tokens.getType(peekIndex);
   }
 
   // Checks if the current token is of the given type.
-  bool isToken(TokenType type) { return this->currentToken.type == type; }
+  bool isToken(TokenType type) {
+    return this->tokens.getType(this->index) == type;
+  }
 
-  // Consume the current token, regardless of what type it is.
-  Result<None> consumeToken() {
-    TRY(this->currentToken, this->tokenizer.next());
-    return Ok();
+  // Consume the current token, regardless of what type it is. The final END
+  // token is never consumed.
+  void consumeToken() {
+    if (this->index + 1 < this->tokens.size()) {
+      this->index++;
+    }
   }
 
   // Consumes the current token if it is of the given type, and advances to the
   // next token.
   Result<None> consumeToken(TokenType type) {
-    TRY([[maybe_unused]] Token token, this->getToken(type));
+    if (!this->isToken(type)) {
+      return Error("Expected {} but got {}.", tokenTypeToString(type),
+                   this->getTokenType());
+    }
+    this->consumeToken();
     return Ok();
   }
 
-  // Returns the current token if it is of the given type and advances to the
-  // next one.
-  Result<Token> getToken(TokenType type) {
-    if (this->isToken(type)) {
-      Token consumed = this->currentToken;
-      TRY(this->currentToken, this->tokenizer.next());
-      return Ok(consumed);
-    } else {
+  // Get's the value of the current token only if it matches the given type,
+  // and advances to the next one.
+  Result<StringView> getTokenValue(TokenType type) {
+    if (!this->isToken(type)) {
       return Error("Expected {} but got {}.", tokenTypeToString(type),
                    this->getTokenType());
     }
+    StringView value = this->tokens.getValue(this->index);
+    this->consumeToken();
+    return Ok(value);
   }
 
-  // Get's the value of the current token only if it matches the given type.
-  Result<StringView> getTokenValue(TokenType type) {
-    TRY(Token token, this->getToken(type));
-    return Ok(StringView(&this->code[token.start], token.end - token.start));
+  // Interns the name of the current token only if it's an identifier, and
+  // advances to the next one.
+  Result<Symbol> getIdentifier() {
+    TRY(StringView name, this->getTokenValue(TokenType::IDENTIFIER));
+    return Ok(symbolTable.intern(name));
   }
 
   StringView getTokenType() {
-    return tokenTypeToString(this->currentToken.type);
+    return tokenTypeToString(this->tokens.getType(this->index));
   }
 
   Location getLocation() {
-    return this->tokenizer.getLocation(this->currentToken.start);
+    return this->tokenizer.getLocation(this->tokens.getStart(this->index));
   }
 
   Result<FunctionDeclaration> parseFunctionDeclaration() {
+    bool isExported = this->isToken(TokenType::PUB);
+    if (isExported) {
+      this->consumeToken();
+    }
     TRY(this->consumeToken(TokenType::FN));
 
-    TRY(StringView name, this->getTokenValue(TokenType::IDENTIFIER));
+    Location location = this->getLocation();
+    TRY(Symbol name, this->getIdentifier());
 
-    TRY(Vector<FunctionParameter> parameters, this->parseFunctionParameters());
+    TRY(Range<FunctionParameter> parameters, this->parseFunctionParameters());
 
     // Parse function return value, defaulting to void if there is none.
     Type returnType = Type(BaseType::VOID);
+    Location returnTypeLocation = location;
     if (this->isToken(TokenType::COLON)) {
-      TRY(this->consumeToken());
+      this->consumeToken();
+      returnTypeLocation = this->getLocation();
       TRY(returnType, this->parseType());
     }
 
     // Parse statement block.
     TRY(StatementBlock body, parseStatementBlock());
 
-    return Ok(FunctionDeclaration{.name = std::move(name),
-                                  .params = std::move(parameters),
+    return Ok(FunctionDeclaration{.name = name,
+                                  .params = parameters,
                                   .returnType = std::move(returnType),
-                                  .body = std::move(body)});
+                                  .body = std::move(body),
+                                  .location = location,
+                                  .returnTypeLocation = returnTypeLocation,
+                                  .isExported = isExported});
   }
 
-  Result<Vector<FunctionParameter>> parseFunctionParameters() {
-    Vector<FunctionParameter> parameters;
+  Result<Range<FunctionParameter>> parseFunctionParameters() {
+    size_t scratchStart = this->parameterScratch.size();
     TRY(this->consumeToken(TokenType::LEFT_PAREN));
 
     // Return early if there are no parameters.
     if (this->isToken(TokenType::RIGHT_PAREN)) {
-      TRY(this->consumeToken());
-      return Ok(parameters);
+      this->consumeToken();
+      return Ok(Range<FunctionParameter>{});
     }
 
     // Parse function parameters.
     while (true) {
-      TRY(StringView name, this->getTokenValue(TokenType::IDENTIFIER));
+      Location location = this->getLocation();
+      TRY(Symbol name, this->getIdentifier());
       TRY(this->consumeToken(TokenType::COLON));
       TRY(Type type, this->parseType());
-      parameters.push_back(FunctionParameter{.name = name, .type = type});
+      this->parameterScratch.push_back(
+          FunctionParameter{.name = name, .type = type, .location = location});
 
       // Continue if there are more parameters.
       if (this->isToken(TokenType::COMMA)) {
-        TRY(this->consumeToken());
+        this->consumeToken();
         continue;
       }
       break;
@@ -123,32 +223,35 @@ struct Parser {
 
     // Consume closing parenthesis.
     TRY(this->consumeToken(TokenType::RIGHT_PAREN));
-    return Ok(parameters);
+    return Ok(this->ast.addRange(this->parameterScratch, scratchStart));
   }
 
   Result<StatementBlock> parseStatementBlock() {
+    Location location = this->getLocation();
     // Consume the opening brace.
     TRY(this->consumeToken(TokenType::LEFT_BRACE));
 
-    Vector<Statement> statements;
+    size_t scratchStart = this->statementScratch.size();
     while (true) {
       // Consume any preceding, or trailing newlines.
       if (this->isToken(TokenType::NEWLINE)) {
-        TRY(this->consumeToken());
+        this->consumeToken();
       }
       // Exit the loop if we encounter the closing brace.
       else if (this->isToken(TokenType::RIGHT_BRACE)) {
-        TRY(this->consumeToken());
+        this->consumeToken();
         break;
       }
       // Parse statement.
       else {
         TRY(Statement statement, this->parseStatement());
-        statements.push_back(std::move(statement));
+        this->statementScratch.push_back(statement);
       }
     }
 
-    return Ok(StatementBlock{.statements = std::move(statements)});
+    return Ok(StatementBlock{
+        .statements = this->ast.addRange(this->statementScratch, scratchStart),
+        .location = location});
   }
 
   Result<Statement> parseStatement() {
@@ -164,32 +267,116 @@ struct Parser {
     }
     // Fail for every other token type.
     Location loc = this->getLocation();
-    return Error("Unexpected token {} at {}:{} when parsing statement block.",
-                 this->getTokenType(), loc.line, loc.col);
+    return Error("Unexpected token {} at {} when parsing statement block.",
+                 this->getTokenType(), loc);
   }
 
+  // Parses an expression with binary operators by precedence climbing. Operands
+  // and operators are kept on explicit stacks instead of recursing for each
+  // operator or parenthesis, so deeply nested generated expressions can't
+  // overflow the native stack.
   Result<Expression> parseExpression() {
-    Expression left;
-    // Parse the first expression which could potentially be the left side of a
-    // binary operation.
+    size_t operandStart = this->operandStack.size();
+    size_t operatorStart = this->operatorStack.size();
+    size_t openParentheses = 0;
+    while (true) {
+      // Open any parentheses before the operand.
+      while (this->isToken(TokenType::LEFT_PAREN)) {
+        this->operatorStack.push_back(PendingOperator{.precedence = 0});
+        this->consumeToken();
+        openParentheses++;
+      }
+
+      TRY(Expression operand, this->parseOperand());
+      this->operandStack.push_back(
+          Operand{.expression = operand, .depth = this->expressionDepth});
+
+      // Close the parentheses opened within this expression. Any other closing
+      // parenthesis belongs to an enclosing function call.
+      while (openParentheses > 0 && this->isToken(TokenType::RIGHT_PAREN)) {
+        TRY(this->reduceOperators(operatorStart, 1));
+        this->operatorStack.pop_back();
+        this->consumeToken();
+        openParentheses--;
+      }
+
+      // Stop at the first token that isn't a binary operator.
+      const auto& entry =
+          binaryOperatorTable.get(this->tokens.getType(this->index));
+      if (entry.precedence == 0) {
+        break;
+      }
+      Location location = this->getLocation();
+      this->consumeToken();
+
+      // Since every operator is left associative, operators on the stack that
+      // bind at least as tightly take this operand as their right side.
+      TRY(this->reduceOperators(operatorStart, entry.precedence));
+      this->operatorStack.push_back(
+          PendingOperator{.op = entry.op,
+                          .precedence = entry.precedence,
+                          .location = location});
+    }
+
+    if (openParentheses > 0) {
+      TRY(this->consumeToken(TokenType::RIGHT_PAREN));
+    }
+    TRY(this->reduceOperators(operatorStart, 1));
+
+    Operand expression = this->operandStack.back();
+    this->operandStack.resize(operandStart);
+    this->expressionDepth = expression.depth;
+    return Ok(expression.expression);
+  }
+
+  // Pops the operators above the given start with at least the given
+  // precedence, replacing their operands with a BinaryExpression. Stops at
+  // open parentheses, since they have a precedence of 0.
+  Result<None> reduceOperators(size_t operatorStart, int minPrecedence) {
+    while (this->operatorStack.size() > operatorStart &&
+           this->operatorStack.back().precedence >= minPrecedence) {
+      PendingOperator pending = this->operatorStack.back();
+      this->operatorStack.pop_back();
+      Operand right = this->operandStack.back();
+      this->operandStack.pop_back();
+      Operand left = this->operandStack.back();
+      uint32_t depth = std::max(left.depth, right.depth) + 1;
+      if (depth > MAX_EXPRESSION_DEPTH) {
+        return Error("Expression at {} is nested more than {} levels deep.",
+                     pending.location, MAX_EXPRESSION_DEPTH);
+      }
+      this->operandStack.back() = Operand{
+          .expression = this->ast.addExpression(
+              BinaryExpression{.op = pending.op,
+                               .left = left.expression,
+                               .right = right.expression,
+                               .location = pending.location}),
+          .depth = depth};
+    }
+    return Ok();
+  }
+
+  // Parses a single operand of a binary expression.
+  Result<Expression> parseOperand() {
+    Location location = this->getLocation();
+    this->expressionDepth = 1;
     if (this->isToken(TokenType::IDENTIFIER)) {
-      TRY(left, this->parseIdentifierExpression());
+      TRY(Expression expression, this->parseIdentifierExpression());
+      return Ok(expression);
     } else if (this->isToken(TokenType::STRING_LITERAL)) {
       // TODO: Remove need for specifying token type in this case.
       TRY(StringView value, this->getTokenValue(TokenType::STRING_LITERAL));
-      return Ok(StringLiteral::make(std::move(value)));
+      return Ok(this->ast.addExpression(
+          StringLiteral{.value = value, .location = location}));
     } else if (this->isToken(TokenType::NUMBER_LITERAL)) {
       TRY(StringView value, this->getTokenValue(TokenType::NUMBER_LITERAL));
-      return Ok(NumberLiteral::make(std::move(value)));
+      return Ok(this->ast.addExpression(
+          NumberLiteral{.value = value, .location = location}));
     } else {
-      Location loc = this->getLocation();
       return Error(
-          "Unexpected token {} at {}:{} when parsing identifier expression.",
-          this->getTokenType(), loc.line, loc.col);
+          "Unexpected token {} at {} when parsing identifier expression.",
+          this->getTokenType(), location);
     }
-
-    // TODO: Parse right side of binary operation.
-    return Ok(std::move(left));
   }
 
   Result<Type> parseType() {
@@ -201,78 +388,129 @@ struct Parser {
       TRY(this->consumeToken(TokenType::FLOAT));
       return Ok((Type)BaseType::FLOAT);
     }
+    if (this->isToken(TokenType::STRING)) {
+      TRY(this->consumeToken(TokenType::STRING));
+      return Ok((Type)BaseType::STRING);
+    }
     return Error("Unexpected token {} when parsing type.",
                  this->getTokenType());
   }
 
   // TODO: Combine with parseIdentifierExpression()
   Result<Statement> parseIdentifierStatement() {
-    TRY(StringView name, this->getTokenValue(TokenType::IDENTIFIER));
+    Location location = this->getLocation();
+    TRY(Symbol name, this->getIdentifier());
 
     // Parse function call statement, ensuring we see a newline after.
     if (this->isToken(TokenType::LEFT_PAREN)) {
-      TRY(Vector<Expression> args, this->parseFunctionCallArguments());
-      return Ok(FunctionCall::makeStatement(std::move(name), std::move(args)));
+      TRY(Range<Expression> args, this->parseFunctionCallArguments());
+      return Ok(this->ast.addStatement(
+          FunctionCall{.name = name, .args = args, .location = location}));
+    }
+
+    // Parse variable declaration, either with its type as in x: int = 5, or
+    // with the type left to be inferred as in x := 5.
+    if (this->isToken(TokenType::COLON)) {
+      this->consumeToken();
+      bool hasDeclaredType = !this->isToken(TokenType::EQUAL);
+      Type type;
+      if (hasDeclaredType) {
+        TRY(type, this->parseType());
+      }
+      TRY(this->consumeToken(TokenType::EQUAL));
+      TRY(Expression expression, this->parseExpression());
+      return Ok(this->ast.addStatement(
+          VariableDeclaration{.name = name,
+                              .type = std::move(type),
+                              .expression = expression,
+                              .location = location,
+                              .hasDeclaredType = hasDeclaredType}));
     }
 
     Location loc = this->getLocation();
     return Error(
-        "Unexpected token {} at {}:{} when parsing identifier statement.",
-        this->getTokenType(), loc.line, loc.col);
+        "Unexpected token {} at {} when parsing identifier statement.",
+        this->getTokenType(), loc);
   }
 
-  Result<Vector<Expression>> parseFunctionCallArguments() {
-    Vector<Expression> args;
+  // Parses the arguments of a call, leaving the deepest one's depth in
+  // expressionDepth.
+  Result<Range<Expression>> parseFunctionCallArguments() {
+    size_t scratchStart = this->expressionScratch.size();
+    this->expressionDepth = 0;
 
     // Consume opening parenthesis.
     TRY(this->consumeToken(TokenType::LEFT_PAREN));
 
     // Return early if there are no arguments.
     if (this->isToken(TokenType::RIGHT_PAREN)) {
-      TRY(this->consumeToken());
-      return Ok(std::move(args));
+      this->consumeToken();
+      return Ok(Range<Expression>{});
     }
 
-    // Parse arguments.
+    // Parse arguments. Calls are nested by recursing, so the nesting is
+    // checked before going deeper.
+    if (this->callDepth == MAX_EXPRESSION_DEPTH) {
+      Location loc = this->getLocation();
+      return Error("Expression at {} is nested more than {} levels deep.", loc,
+                   MAX_EXPRESSION_DEPTH);
+    }
+    this->callDepth++;
+    uint32_t depth = 0;
     while (true) {
       TRY(Expression expr, this->parseExpression());
-      args.push_back(std::move(expr));
+      this->expressionScratch.push_back(expr);
+      depth = std::max(depth, this->expressionDepth);
 
       // Continue parsing more arguments if there is a comma.
       if (this->isToken(TokenType::COMMA)) {
-        TRY(this->consumeToken());
+        this->consumeToken();
+        continue;
       }
       break;
     }
 
+    this->callDepth--;
+    this->expressionDepth = depth;
+
     // Consume closing parenthesis.
     TRY(this->consumeToken(TokenType::RIGHT_PAREN));
 
-    return Ok(std::move(args));
+    return Ok(this->ast.addRange(this->expressionScratch, scratchStart));
   }
 
   // TODO: Combine with parseIdentifierStatement()
   Result<Expression> parseIdentifierExpression() {
-    TRY(StringView name, this->getTokenValue(TokenType::IDENTIFIER));
+    Location location = this->getLocation();
+    TRY(Symbol name, this->getIdentifier());
 
     // Parse function call statement, ensuring we see a newline after.
     if (this->isToken(TokenType::LEFT_PAREN)) {
-      TRY(Vector<Expression> args, this->parseFunctionCallArguments());
-      return Ok(FunctionCall::makeExpression(std::move(name), std::move(args)));
+      TRY(Range<Expression> args, this->parseFunctionCallArguments());
+      if (this->expressionDepth == MAX_EXPRESSION_DEPTH) {
+        return Error("Expression at {} is nested more than {} levels deep.",
+                     location, MAX_EXPRESSION_DEPTH);
+      }
+      this->expressionDepth++;
+      return Ok(this->ast.addExpression(
+          FunctionCall{.name = name, .args = args, .location = location}));
     }
 
     // Otherwise, we just have a variable reference.
-    return Ok(VariableReference::make(std::move(name)));
+    return Ok(this->ast.addExpression(
+        VariableReference{.name = name, .location = location}));
   }
 
   Result<Statement> parseReturnStatement() {
+    Location location = this->getLocation();
     TRY(this->consumeToken(TokenType::RETURN));
 
     Optional<Expression> expression = std::nullopt;
     if (!this->isToken(TokenType::NEWLINE)) {
       TRY(expression, this->parseExpression());
     }
-    return Ok(Return::makeStatement(std::move(expression)));
+    return Ok(this->ast.addStatement(
+        Return{.expression = expression, .location = location}));
   }
 };
 
@@ -0,0 +1,257 @@
+#ifndef SCAN_CC
+#define SCAN_CC
+
+#include "builtins.cc"
+
+#if defined(__x86_64__) || defined(_M_X64)
+#include <immintrin.h>
+#define SCAN_X86 1
+#endif
+
+// Character classes that the tokenizer consumes in runs. Each class knows how
+// to test a single character, and on x86 how to test a whole SSE2 or AVX2
+// block at once, producing 0xFF in every byte lane that belongs to the class.
+struct SpaceClass {
+  static bool matches(char c) { return c == ' ' || c == '\t' || c == '\r'; }
+
+#ifdef SCAN_X86
+  static __m128i matches(__m128i block) {
+    __m128i space = _mm_cmpeq_epi8(block, _mm_set1_epi8(' '));
+    __m128i tab = _mm_cmpeq_epi8(block, _mm_set1_epi8('\t'));
+    __m128i carriage = _mm_cmpeq_epi8(block, _mm_set1_epi8('\r'));
+    return _mm_or_si128(_mm_or_si128(space, tab), carriage);
+  }
+
+  __attribute__((target("avx2"))) static __m256i matches(__m256i block) {
+    __m256i space = _mm256_cmpeq_epi8(block, _mm256_set1_epi8(' '));
+    __m256i tab = _mm256_cmpeq_epi8(block, _mm256_set1_epi8('\t'));
+    __m256i carriage = _mm256_cmpeq_epi8(block, _mm256_set1_epi8('\r'));
+    return _mm256_or_si256(_mm256_or_si256(space, tab), carriage);
+  }
+#endif
+};
+
+// Whitespace within parenthesis, where newlines are skipped as well.
+struct SpaceOrNewlineClass {
+  static bool matches(char c) { return SpaceClass::matches(c) || c == '\n'; }
+
+#ifdef SCAN_X86
+  static __m128i matches(__m128i block) {
+    __m128i newline = _mm_cmpeq_epi8(block, _mm_set1_epi8('\n'));
+    return _mm_or_si128(SpaceClass::matches(block), newline);
+  }
+
+  __attribute__((target("avx2"))) static __m256i matches(__m256i block) {
+    __m256i newline = _mm256_cmpeq_epi8(block, _mm256_set1_epi8('\n'));
+    return _mm256_or_si256(SpaceClass::matches(block), newline);
+  }
+#endif
+};
+
+struct DigitClass {
+  static bool matches(char c) { return c >= '0' && c <= '9'; }
+
+#ifdef SCAN_X86
+  // Bytes are compared as signed values, so anything outside of ASCII is
+  // negative and never falls within the range.
+  static __m128i matches(__m128i block) {
+    __m128i aboveZero = _mm_cmpgt_epi8(block, _mm_set1_epi8('0' - 1));
+    __m128i belowNine = _mm_cmplt_epi8(block, _mm_set1_epi8('9' + 1));
+    return _mm_and_si128(aboveZero, belowNine);
+  }
+
+  __attribute__((target("avx2"))) static __m256i matches(__m256i block) {
+    __m256i aboveZero = _mm256_cmpgt_epi8(block, _mm256_set1_epi8('0' - 1));
+    __m256i belowNine = _mm256_cmpgt_epi8(_mm256_set1_epi8('9' + 1), block);
+    return _mm256_and_si256(aboveZero, belowNine);
+  }
+#endif
+};
+
+struct IdentifierClass {
+  static bool matches(char c) {
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_' ||
+           DigitClass::matches(c);
+  }
+
+#ifdef SCAN_X86
+  // Setting bit 0x20 folds upper case letters onto lower case ones without
+  // moving any other character into the 'a' to 'z' range.
+  static __m128i matches(__m128i block) {
+    __m128i lower = _mm_or_si128(block, _mm_set1_epi8(0x20));
+    __m128i aboveA = _mm_cmpgt_epi8(lower, _mm_set1_epi8('a' - 1));
+    __m128i belowZ = _mm_cmplt_epi8(lower, _mm_set1_epi8('z' + 1));
+    __m128i letter = _mm_and_si128(aboveA, belowZ);
+    __m128i underscore = _mm_cmpeq_epi8(block, _mm_set1_epi8('_'));
+    return _mm_or_si128(_mm_or_si128(letter, underscore),
+                        DigitClass::matches(block));
+  }
+
+  __attribute__((target("avx2"))) static __m256i matches(__m256i block) {
+    __m256i lower = _mm256_or_si256(block, _mm256_set1_epi8(0x20));
+    __m256i aboveA = _mm256_cmpgt_epi8(lower, _mm256_set1_epi8('a' - 1));
+    __m256i belowZ = _mm256_cmpgt_epi8(_mm256_set1_epi8('z' + 1), lower);
+    __m256i letter = _mm256_and_si256(aboveA, belowZ);
+    __m256i underscore = _mm256_cmpeq_epi8(block, _mm256_set1_epi8('_'));
+    return _mm256_or_si256(_mm256_or_si256(letter, underscore),
+                           DigitClass::matches(block));
+  }
+#endif
+};
+
+// Every character within a string literal, up to the closing quote.
+struct StringBodyClass {
+  static bool matches(char c) { return c != '"'; }
+
+#ifdef SCAN_X86
+  static __m128i matches(__m128i block) {
+    __m128i quote = _mm_cmpeq_epi8(block, _mm_set1_epi8('"'));
+    return _mm_andnot_si128(quote, _mm_set1_epi8(-1));
+  }
+
+  __attribute__((target("avx2"))) static __m256i matches(__m256i block) {
+    __m256i quote = _mm256_cmpeq_epi8(block, _mm256_set1_epi8('"'));
+    return _mm256_andnot_si256(quote, _mm256_set1_epi8(-1));
+  }
+#endif
+};
+
+// Characters that never change whether the following newline is within a
+// string or parenthesis.
+struct UnstructuredClass {
+  static bool matches(char c) {
+    return c != '"' && c != '(' && c != ')' && c != '\n';
+  }
+
+#ifdef SCAN_X86
+  static __m128i matches(__m128i block) {
+    __m128i quote = _mm_cmpeq_epi8(block, _mm_set1_epi8('"'));
+    __m128i open = _mm_cmpeq_epi8(block, _mm_set1_epi8('('));
+    __m128i close = _mm_cmpeq_epi8(block, _mm_set1_epi8(')'));
+    __m128i newline = _mm_cmpeq_epi8(block, _mm_set1_epi8('\n'));
+    __m128i structure =
+        _mm_or_si128(_mm_or_si128(quote, open), _mm_or_si128(close, newline));
+    return _mm_andnot_si128(structure, _mm_set1_epi8(-1));
+  }
+
+  __attribute__((target("avx2"))) static __m256i matches(__m256i block) {
+    __m256i quote = _mm256_cmpeq_epi8(block, _mm256_set1_epi8('"'));
+    __m256i open = _mm256_cmpeq_epi8(block, _mm256_set1_epi8('('));
+    __m256i close = _mm256_cmpeq_epi8(block, _mm256_set1_epi8(')'));
+    __m256i newline = _mm256_cmpeq_epi8(block, _mm256_set1_epi8('\n'));
+    __m256i structure = _mm256_or_si256(_mm256_or_si256(quote, open),
+                                        _mm256_or_si256(close, newline));
+    return _mm256_andnot_si256(structure, _mm256_set1_epi8(-1));
+  }
+#endif
+};
+
+// Returns the index of the first character at or after index that doesn't
+// belong to the character class, or the length of the code if there is none.
+template <typename CharClass>
+size_t scanScalar(StringView code, size_t index) {
+  while (index < code.length() && CharClass::matches(code[index])) {
+    index++;
+  }
+  return index;
+}
+
+#ifdef SCAN_X86
+// Classifies 16 characters per step, finishing the last partial block with the
+// scalar loop so that we never read past the end of the code.
+template <typename CharClass>
+size_t scanSse2(StringView code, size_t index) {
+  const char* data = code.data();
+  while (index + 16 <= code.length()) {
+    __m128i block = _mm_loadu_si128((const __m128i*)(data + index));
+    uint32_t mismatches =
+        ~(uint32_t)_mm_movemask_epi8(CharClass::matches(block)) & 0xFFFF;
+    if (mismatches != 0) {
+      return index + __builtin_ctz(mismatches);
+    }
+    index += 16;
+  }
+  return scanScalar<CharClass>(code, index);
+}
+
+// Classifies 32 characters per step, falling back to SSE2 for the tail.
+template <typename CharClass>
+__attribute__((target("avx2"))) size_t scanAvx2(StringView code,
+                                                 size_t index) {
+  const char* data = code.data();
+  while (index + 32 <= code.length()) {
+    __m256i block = _mm256_loadu_si256((const __m256i*)(data + index));
+    uint32_t mismatches =
+        ~(uint32_t)_mm256_movemask_epi8(CharClass::matches(block));
+    if (mismatches != 0) {
+      return index + __builtin_ctz(mismatches);
+    }
+    index += 32;
+  }
+  return scanSse2<CharClass>(code, index);
+}
+#endif
+
+// Scan implementation enum and their string names for debugging.
+#define FOREACH_SCAN_IMPLEMENTATION(GENERATOR) \
+  GENERATOR(SCALAR)                            \
+  GENERATOR(SSE2)                              \
+  GENERATOR(AVX2)
+enum class ScanImplementation { FOREACH_SCAN_IMPLEMENTATION(ENUM_GENERATOR) };
+static const char* scanImplementationString[] = {
+    FOREACH_SCAN_IMPLEMENTATION(STRING_GENERATOR)};
+StringView scanImplementationToString(ScanImplementation implementation) {
+  return scanImplementationString[static_cast<int>(implementation)];
+}
+
+// Whether the current CPU can run the given implementation.
+bool isScanImplementationSupported(ScanImplementation implementation) {
+#ifdef SCAN_X86
+  if (implementation == ScanImplementation::AVX2) {
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2");
+  }
+  // SSE2 is part of the x86-64 baseline.
+  return true;
+#else
+  return implementation == ScanImplementation::SCALAR;
+#endif
+}
+
+// Picks the widest implementation the current CPU supports.
+ScanImplementation getBestScanImplementation() {
+  if (isScanImplementationSupported(ScanImplementation::AVX2)) {
+    return ScanImplementation::AVX2;
+  }
+  if (isScanImplementationSupported(ScanImplementation::SSE2)) {
+    return ScanImplementation::SSE2;
+  }
+  return ScanImplementation::SCALAR;
+}
+
+// Implementation used by every tokenizer, selected once at startup. Benchmarks
+// and tests may swap it for a specific one.
+ScanImplementation scanImplementation = getBestScanImplementation();
+
+// Returns the index of the first character at or after index that doesn't
+// belong to the character class, using the selected implementation. Most runs
+// in real code are a handful of characters long, so the first character is
+// checked inline before paying for a vector scan.
+template <typename CharClass>
+inline size_t scan(StringView code, size_t index) {
+  if (index >= code.length() || !CharClass::matches(code[index])) {
+    return index;
+  }
+  index++;
+#ifdef SCAN_X86
+  if (scanImplementation == ScanImplementation::AVX2) {
+    return scanAvx2<CharClass>(code, index);
+  }
+  if (scanImplementation == ScanImplementation::SSE2) {
+    return scanSse2<CharClass>(code, index);
+  }
+#endif
+  return scanScalar<CharClass>(code, index);
+}
+
+#endif  // SCAN_CC
@@ -0,0 +1,125 @@
+#ifndef SCOPED_SYMBOL_MAP_CC
+#define SCOPED_SYMBOL_MAP_CC
+
+#include "builtins.cc"
+#include "symbol_table.cc"
+
+// Open addressing hash map from symbols to values, with nested scopes. Names
+// set in a scope are removed, and the values they shadowed restored, when the
+// scope is popped. Every scope shares the same slots, so entering a scope
+// allocates nothing and a lookup is a single probe sequence however deeply
+// scopes are nested.
+//
+// Names are always removed in the reverse order they were added, so the slots
+// always look as if only the remaining names had ever been added. That means a
+// removed name's slot can simply be emptied, without leaving a tombstone.
+template <typename T>
+struct ScopedSymbolMap {
+  struct Slot {
+    // Symbol id plus one, or 0 for an empty slot.
+    uint32_t key = 0;
+    // Number of scopes that were open when the value was set.
+    uint32_t depth = 0;
+    T value;
+  };
+
+  // Change made by set(), undone when its scope is popped.
+  struct Change {
+    Symbol symbol;
+    // The slot's previous depth and value if the symbol was already set, which
+    // happens when shadowing it.
+    uint32_t shadowedDepth = 0;
+    Optional<T> shadowed;
+  };
+
+  // Power of two number of slots, kept at least twice the number of names.
+  Vector<Slot> slots = Vector<Slot>(16);
+  Vector<Change> changes;
+  // Number of changes made before each scope that is still open.
+  Vector<size_t> scopeStarts;
+  size_t count = 0;
+
+  void pushScope() { this->scopeStarts.push_back(this->changes.size()); }
+
+  void popScope() {
+    size_t scopeStart = this->scopeStarts.back();
+    this->scopeStarts.pop_back();
+    while (this->changes.size() > scopeStart) {
+      Change& change = this->changes.back();
+      Slot& slot = this->slots[findSlot(this->slots, change.symbol)];
+      if (change.shadowed.has_value()) {
+        slot.depth = change.shadowedDepth;
+        slot.value = std::move(change.shadowed.value());
+      } else {
+        slot.key = 0;
+        this->count--;
+      }
+      this->changes.pop_back();
+    }
+  }
+
+  // Sets the value of the symbol in the innermost scope, shadowing any value
+  // it has in an enclosing one.
+  void set(Symbol symbol, T value) {
+    Slot& slot = this->slots[findSlot(this->slots, symbol)];
+    uint32_t depth = this->scopeStarts.size();
+    if (slot.key != 0) {
+      this->changes.push_back(Change{.symbol = symbol,
+                                     .shadowedDepth = slot.depth,
+                                     .shadowed = std::move(slot.value)});
+      slot.depth = depth;
+      slot.value = std::move(value);
+      return;
+    }
+    slot =
+        Slot{.key = symbol.id + 1, .depth = depth, .value = std::move(value)};
+    this->changes.push_back(Change{.symbol = symbol});
+    this->count++;
+    if (this->count * 2 > this->slots.size()) {
+      this->grow();
+    }
+  }
+
+  // Returns the value of the symbol in the innermost scope that has it.
+  T* get(Symbol symbol) {
+    Slot& slot = this->slots[findSlot(this->slots, symbol)];
+    return slot.key != 0 ? &slot.value : nullptr;
+  }
+  const T* get(Symbol symbol) const {
+    const Slot& slot = this->slots[findSlot(this->slots, symbol)];
+    return slot.key != 0 ? &slot.value : nullptr;
+  }
+
+  // Whether the symbol was set in the innermost scope.
+  bool isInCurrentScope(Symbol symbol) const {
+    const Slot& slot = this->slots[findSlot(this->slots, symbol)];
+    return slot.key != 0 && slot.depth == this->scopeStarts.size();
+  }
+
+  // Returns the slot holding the symbol, or the empty slot it would go in.
+  static size_t findSlot(const Vector<Slot>& slots, Symbol symbol) {
+    size_t mask = slots.size() - 1;
+    // Symbol ids are dense, and multiplying by an odd constant scatters
+    // neighbouring ids across the slots without any of them colliding.
+    size_t index = (symbol.id * 0x9E3779B1u) & mask;
+    while (slots[index].key != 0 && slots[index].key != symbol.id + 1) {
+      index = (index + 1) & mask;
+    }
+    return index;
+  }
+
+  // Doubles the number of slots. Names are added back in the order they were
+  // first added, which keeps removals valid without tombstones.
+  void grow() {
+    Vector<Slot> oldSlots = std::move(this->slots);
+    this->slots = Vector<Slot>(oldSlots.size() * 2);
+    for (const auto& change : this->changes) {
+      if (!change.shadowed.has_value()) {
+        this->slots[findSlot(this->slots, change.symbol)] =
+            std::move(oldSlots[findSlot(oldSlots, change.symbol)]);
+      }
+    }
+  }
+};
+
+#endif  // SCOPED_SYMBOL_MAP_CC
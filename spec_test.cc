@@ -13,10 +13,35 @@ struct TestCase {
 struct SpecTest {
   StringView testFileName;
   Result<String> (*getActualResult)(const TestCase& testCase);
+  // Tells apart tests running the same file through different code paths, or
+  // empty if only one test runs the file.
+  StringView label;
 
   SpecTest(StringView testFileName,
-           Result<String> (*getActualResult)(const TestCase& testCase))
-      : testFileName(testFileName), getActualResult(getActualResult) {}
+           Result<String> (*getActualResult)(const TestCase& testCase),
+           StringView label = "")
+      : testFileName(testFileName),
+        getActualResult(getActualResult),
+        label(label) {}
+
+  // Name of the test in reports, like "compiler.test (streaming)".
+  String getName() const {
+    if (this->label.empty()) {
+      return String(this->testFileName);
+    }
+    return std::format("{} ({})", this->testFileName, this->label);
+  }
+
+  // File the actual results are written to, which is named after the label
+  // too so tests of the same file don't overwrite each other's results.
+  String getActualResultFileName() const {
+    if (this->label.empty()) {
+      return "build/" + String(this->testFileName);
+    }
+    StringView baseName = this->testFileName.substr(
+        0, this->testFileName.rfind(".test"));
+    return std::format("build/{}.{}.test", baseName, this->label);
+  }
 
   Result<bool> run() {
     TRY(String testFile, readFile(testFileName));
@@ -26,8 +51,7 @@ struct SpecTest {
 
     // Write updated spec tests.
     String actualSpecTests = this->generateSpecTests(testCases, actualResults);
-    TRY(writeFile(String("build/") + String(this->testFileName),
-                  actualSpecTests));
+    TRY(writeFile(this->getActualResultFileName(), actualSpecTests));
 
     // Check if the actual results match expected ones.
     bool testsPassed = true;
@@ -178,11 +202,13 @@ struct SpecTest {
   Vector<String> getActualResults(Vector<TestCase>& testCases) {
     Vector<String> results;
     for (const auto& testCase : testCases) {
+      // Every test case is a compilation of its own.
+      DiagnosticsScope diagnosticsScope;
       Result<String> result = this->getActualResult(testCase);
       if (result.ok) {
         results.push_back(result.value);
       } else {
-        results.push_back(result.error);
+        results.push_back(result.getError());
       }
     }
     return results;
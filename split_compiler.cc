@@ -0,0 +1,272 @@
+#ifndef SPLIT_COMPILER_CC
+#define SPLIT_COMPILER_CC
+
+#include "ast.cc"
+#include "builtins.cc"
+#include "call_graph.cc"
+#include "compiler.cc"
+#include "file.cc"
+#include "output_buffer.cc"
+
+// Largest compiled leaf function, in bytes, that is defined static inline in
+// the header when other translation units call it.
+const size_t MAX_HEADER_INLINE_SIZE = 160;
+
+// How a function is compiled when the program is split into several
+// translation units.
+enum class Linkage {
+  // Defined in its unit and declared in the header for the others.
+  EXTERN,
+  // Only called from its own unit, so it's defined static there, which lets
+  // the C compiler inline it or drop it.
+  STATIC,
+  // Small leaf called from other units, so it's defined static inline in the
+  // header for every unit to inline.
+  HEADER_INLINE,
+};
+
+// File generated by the SplitCompiler.
+struct OutputFile {
+  String name;
+  String text;
+};
+
+// Compiles the program into a header and several .c files that can be
+// compiled in parallel, plus a manifest listing them. The header has the
+// includes, a prototype for every function called across units and the small
+// leaf functions other units call. Each .c file has a contiguous run of
+// functions of about the same size, since nearby functions tend to call each
+// other. Must run after the Analyzer, since it uses the call graph.
+struct SplitCompiler {
+  // Name the generated files start with.
+  String baseName;
+  // Number of .c files to generate, which is less if there are fewer
+  // functions.
+  size_t unitCount;
+
+  // Returns the header, then the .c files in order, then the manifest.
+  Result<Vector<OutputFile>> compileProgram(const Program& node) {
+    size_t functionCount = node.functions.size();
+    // Compile every definition and signature once into one buffer, keeping
+    // where each starts, so the files are pieced together by copying.
+    Compiler compiler = {.ast = &node.ast};
+    compiler.out.reserve(node.sourceSize * OUTPUT_SIZE_PER_SOURCE_BYTE * 3 / 2);
+    Vector<size_t> definitionStarts(functionCount + 1);
+    Vector<size_t> signatureStarts(functionCount + 1);
+    for (size_t i = 0; i < functionCount; i++) {
+      definitionStarts[i] = compiler.out.size();
+      TRY(compiler.compileFunctionDeclaration(node.functions[i]));
+    }
+    definitionStarts[functionCount] = compiler.out.size();
+    for (size_t i = 0; i < functionCount; i++) {
+      signatureStarts[i] = compiler.out.size();
+      TRY(compiler.compileFunctionSignature(node.functions[i]));
+    }
+    signatureStarts[functionCount] = compiler.out.size();
+    String text = compiler.out.take();
+    auto getDefinition = [&](size_t i) {
+      return StringView(text).substr(
+          definitionStarts[i], definitionStarts[i + 1] - definitionStarts[i]);
+    };
+    auto getSignature = [&](size_t i) {
+      return StringView(text).substr(
+          signatureStarts[i], signatureStarts[i + 1] - signatureStarts[i]);
+    };
+
+    // Split the functions into runs of about totalSize / unitCount bytes.
+    // Small leaves may be defined in the header instead, so only the other
+    // functions are counted, which keeps any unit from being left empty.
+    Vector<bool> isHeaderInlineCandidate =
+        this->getHeaderInlineCandidates(node, definitionStarts);
+    size_t totalSize = 0;
+    size_t splitCount = 0;
+    for (size_t i = 0; i < functionCount; i++) {
+      if (!isHeaderInlineCandidate[i]) {
+        totalSize += definitionStarts[i + 1] - definitionStarts[i];
+        splitCount++;
+      }
+    }
+    size_t unitCount =
+        std::max<size_t>(std::min(this->unitCount, splitCount), 1);
+    Vector<uint32_t> units(functionCount);
+    size_t unit = 0;
+    size_t sizeSoFar = 0;
+    size_t splitLeft = splitCount;
+    for (size_t i = 0; i < functionCount; i++) {
+      units[i] = unit;
+      if (isHeaderInlineCandidate[i]) {
+        continue;
+      }
+      sizeSoFar += definitionStarts[i + 1] - definitionStarts[i];
+      splitLeft--;
+      // Leave at least a function for each of the remaining units.
+      bool isUnitFull = sizeSoFar * unitCount >= totalSize * (unit + 1) ||
+                        splitLeft <= unitCount - unit - 1;
+      if (isUnitFull && unit < unitCount - 1) {
+        unit++;
+      }
+    }
+    Vector<Linkage> linkages =
+        this->getLinkages(node, units, isHeaderInlineCandidate);
+
+    String guard = this->getGuardName();
+    OutputBuffer header;
+    header.write("#ifndef ");
+    header.write(guard);
+    header.write("\n#define ");
+    header.write(guard);
+    header.write("\n\n");
+    for (const auto& include : node.includes) {
+      header.write("#include <");
+      header.write(include);
+      header.write(">\n");
+    }
+    if (node.includes.size() > 0) {
+      header.writeChar('\n');
+    }
+    for (size_t i = 0; i < functionCount; i++) {
+      if (linkages[i] == Linkage::EXTERN) {
+        header.write(getSignature(i));
+        header.write(";\n");
+      }
+    }
+    for (size_t i = 0; i < functionCount; i++) {
+      if (linkages[i] == Linkage::HEADER_INLINE) {
+        header.write("\nstatic inline ");
+        header.write(getDefinition(i));
+        header.writeChar('\n');
+      }
+    }
+    header.write("\n#endif  // ");
+    header.write(guard);
+    header.writeChar('\n');
+
+    Vector<OutputFile> files;
+    files.push_back(
+        OutputFile{.name = this->baseName + ".h", .text = header.take()});
+    String manifest = files[0].name + "\n";
+    size_t start = 0;
+    for (size_t unit = 0; unit < unitCount; unit++) {
+      size_t end = start;
+      while (end < functionCount && units[end] == unit) {
+        end++;
+      }
+      OutputBuffer out;
+      out.reserve(definitionStarts[end] - definitionStarts[start] +
+                  (end - start) * 8);
+      out.write("#include \"");
+      out.write(files[0].name);
+      out.write("\"\n");
+      // Declare the static functions first, since they may be called before
+      // they're defined.
+      bool hasStaticFunctions = false;
+      for (size_t i = start; i < end; i++) {
+        if (linkages[i] == Linkage::STATIC) {
+          out.write(hasStaticFunctions ? "static " : "\nstatic ");
+          out.write(getSignature(i));
+          out.write(";\n");
+          hasStaticFunctions = true;
+        }
+      }
+      for (size_t i = start; i < end; i++) {
+        if (linkages[i] == Linkage::STATIC) {
+          out.write("\nstatic ");
+        } else if (linkages[i] == Linkage::EXTERN) {
+          out.writeChar('\n');
+        } else {
+          continue;
+        }
+        out.write(getDefinition(i));
+        out.writeChar('\n');
+      }
+      String name = std::format("{}_{}.c", this->baseName, unit);
+      manifest += name + "\n";
+      files.push_back(OutputFile{.name = name, .text = out.take()});
+      start = end;
+    }
+    files.push_back(OutputFile{.name = this->baseName + ".manifest",
+                               .text = std::move(manifest)});
+    return Ok(std::move(files));
+  }
+
+  // Finds the functions that are defined in the header if they're called from
+  // other units, which are the small leaves called from anywhere other than
+  // main and exported functions.
+  Vector<bool> getHeaderInlineCandidates(
+      const Program& node, const Vector<size_t>& definitionStarts) {
+    size_t functionCount = node.functions.size();
+    Vector<bool> isCalled(functionCount);
+    for (uint32_t caller = 0; caller < functionCount; caller++) {
+      for (uint32_t callee : node.callGraph.getCallees(caller)) {
+        isCalled[callee] = true;
+      }
+    }
+    Vector<bool> isCandidate(functionCount);
+    for (uint32_t i = 0; i < functionCount; i++) {
+      const FunctionDeclaration& function = node.functions[i];
+      isCandidate[i] = function.name != Symbol::MAIN && !function.isExported &&
+                       isCalled[i] && node.callGraph.getCallees(i).empty() &&
+                       definitionStarts[i + 1] - definitionStarts[i] <=
+                           MAX_HEADER_INLINE_SIZE;
+    }
+    return isCandidate;
+  }
+
+  // Picks the linkage of every function given the unit it's in. main and
+  // exported functions keep external linkage, as do functions nothing calls,
+  // which would be unused if they were static.
+  Vector<Linkage> getLinkages(const Program& node,
+                              const Vector<uint32_t>& units,
+                              const Vector<bool>& isHeaderInlineCandidate) {
+    size_t functionCount = node.functions.size();
+    Vector<bool> isCalled(functionCount);
+    Vector<bool> isCalledFromOtherUnits(functionCount);
+    for (uint32_t caller = 0; caller < functionCount; caller++) {
+      for (uint32_t callee : node.callGraph.getCallees(caller)) {
+        isCalled[callee] = true;
+        if (units[callee] != units[caller]) {
+          isCalledFromOtherUnits[callee] = true;
+        }
+      }
+    }
+
+    Vector<Linkage> linkages(functionCount, Linkage::EXTERN);
+    for (uint32_t i = 0; i < functionCount; i++) {
+      const FunctionDeclaration& function = node.functions[i];
+      if (function.name == Symbol::MAIN || function.isExported ||
+          !isCalled[i]) {
+        continue;
+      }
+      if (!isCalledFromOtherUnits[i]) {
+        linkages[i] = Linkage::STATIC;
+      } else if (isHeaderInlineCandidate[i]) {
+        linkages[i] = Linkage::HEADER_INLINE;
+      }
+    }
+    return linkages;
+  }
+
+  // Include guard of the header, which is the base name in upper case with
+  // anything but letters and digits replaced by underscores. A leading digit
+  // is replaced too, since macro names can't start with one.
+  String getGuardName() {
+    String guard;
+    for (char c : this->baseName) {
+      bool isValid = std::isalpha((unsigned char)c) ||
+                     (std::isdigit((unsigned char)c) && !guard.empty());
+      guard += isValid ? std::toupper((unsigned char)c) : '_';
+    }
+    return guard + "_H";
+  }
+};
+
+// Writes the files to the directory, which must exist.
+Result<None> writeOutputFiles(StringView directory,
+                              const Vector<OutputFile>& files) {
+  for (const auto& file : files) {
+    TRY(writeFile(String(directory) + "/" + file.name, file.text));
+  }
+  return Ok();
+}
+
+#endif  // SPLIT_COMPILER_CC
@@ -0,0 +1,135 @@
+#ifndef SYMBOL_TABLE_CC
+#define SYMBOL_TABLE_CC
+
+#include <cstring>
+
+#include "builtins.cc"
+
+// Names the compiler itself refers to, along with their text. They are
+// interned before any other name, so their symbols are known at compile time.
+#define FOREACH_BUILTIN_SYMBOL(GENERATOR) \
+  GENERATOR(MAIN, main)                   \
+  GENERATOR(PRINTLN, println)             \
+  GENERATOR(FORK, fork)
+#define BUILTIN_SYMBOL_ENUM_GENERATOR(NAME, TEXT) NAME,
+enum class BuiltinSymbol : uint32_t {
+  FOREACH_BUILTIN_SYMBOL(BUILTIN_SYMBOL_ENUM_GENERATOR)
+};
+#define BUILTIN_SYMBOL_TEXT_GENERATOR(NAME, TEXT) #TEXT,
+static constexpr const char* builtinSymbolText[] = {
+    FOREACH_BUILTIN_SYMBOL(BUILTIN_SYMBOL_TEXT_GENERATOR)};
+
+// Identifier interned in the symbolTable. Every occurrence of a name maps to
+// the same Symbol, so names can be compared and hashed as plain integers.
+struct Symbol {
+  uint32_t id;
+
+#define BUILTIN_SYMBOL_DECLARATION_GENERATOR(NAME, TEXT) \
+  static const Symbol NAME;
+  FOREACH_BUILTIN_SYMBOL(BUILTIN_SYMBOL_DECLARATION_GENERATOR)
+
+  bool operator==(const Symbol& other) const = default;
+};
+
+#define BUILTIN_SYMBOL_DEFINITION_GENERATOR(NAME, TEXT) \
+  constexpr Symbol Symbol::NAME = {                     \
+      .id = static_cast<uint32_t>(BuiltinSymbol::NAME)};
+FOREACH_BUILTIN_SYMBOL(BUILTIN_SYMBOL_DEFINITION_GENERATOR)
+
+// Interns identifiers, handing out one Symbol per distinct name. Names are
+// copied into chunks owned by the table, so they outlive the source they came
+// from. Interning isn't thread safe, but getName() is as long as nothing is
+// being interned at the same time.
+struct SymbolTable {
+  // Size of each chunk of name storage. Longer names get a chunk of their own.
+  static constexpr size_t CHUNK_SIZE = 64 * 1024;
+
+  // Name and hash of each symbol, indexed by symbol id.
+  Vector<StringView> names;
+  Vector<uint32_t> hashes;
+  // Open addressing hash table of symbol ids plus one, where 0 marks an empty
+  // slot. Its size is a power of two kept at least twice the symbol count.
+  Vector<uint32_t> slots;
+  Vector<Unique<char[]>> chunks;
+  // Next free byte in the current chunk, and the bytes left in it.
+  char* next = nullptr;
+  size_t remaining = 0;
+
+  SymbolTable() {
+    this->slots.resize(64);
+    for (const char* text : builtinSymbolText) {
+      this->intern(text);
+    }
+  }
+
+  // Returns the symbol of the given name, adding it if it's new.
+  Symbol intern(StringView name) {
+    uint32_t hash = hashName(name);
+    size_t mask = this->slots.size() - 1;
+    size_t slot = hash & mask;
+    while (this->slots[slot] != 0) {
+      uint32_t id = this->slots[slot] - 1;
+      if (this->hashes[id] == hash && this->names[id] == name) {
+        return Symbol{.id = id};
+      }
+      slot = (slot + 1) & mask;
+    }
+
+    uint32_t id = this->names.size();
+    this->names.push_back(this->copyName(name));
+    this->hashes.push_back(hash);
+    this->slots[slot] = id + 1;
+    if (this->names.size() * 2 > this->slots.size()) {
+      this->grow();
+    }
+    return Symbol{.id = id};
+  }
+
+  StringView getName(Symbol symbol) const { return this->names[symbol.id]; }
+
+  size_t size() const { return this->names.size(); }
+
+  // FNV-1a, which is cheap for the short names identifiers usually have.
+  static uint32_t hashName(StringView name) {
+    uint32_t hash = 2166136261u;
+    for (char c : name) {
+      hash = (hash ^ (uint8_t)c) * 16777619u;
+    }
+    return hash;
+  }
+
+  // Copies the name into the chunks so it stays valid after the source is
+  // freed.
+  StringView copyName(StringView name) {
+    if (name.size() > this->remaining) {
+      size_t size = std::max(name.size(), CHUNK_SIZE);
+      this->chunks.push_back(Unique<char[]>(new char[size]));
+      this->next = this->chunks.back().get();
+      this->remaining = size;
+    }
+    memcpy(this->next, name.data(), name.size());
+    StringView copy(this->next, name.size());
+    this->next += name.size();
+    this->remaining -= name.size();
+    return copy;
+  }
+
+  // Doubles the number of slots, reinserting every symbol.
+  void grow() {
+    Vector<uint32_t> slots(this->slots.size() * 2);
+    size_t mask = slots.size() - 1;
+    for (uint32_t id = 0; id < this->names.size(); id++) {
+      size_t slot = this->hashes[id] & mask;
+      while (slots[slot] != 0) {
+        slot = (slot + 1) & mask;
+      }
+      slots[slot] = id + 1;
+    }
+    this->slots = std::move(slots);
+  }
+};
+
+// Symbols of every compilation in this process.
+SymbolTable symbolTable;
+
+#endif  // SYMBOL_TABLE_CC
@@ -0,0 +1,162 @@
+#ifndef THREAD_POOL_CC
+#define THREAD_POOL_CC
+
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+#include "builtins.cc"
+
+// Pool of threads that run the iterations of a loop in parallel. The indices
+// of a loop are split evenly between the workers up front. A worker that runs
+// out of its own takes the upper half of another worker's remaining indices,
+// so a few slow iterations don't leave the other workers idle. The thread
+// calling parallelFor() is one of the workers.
+struct ThreadPool {
+  // Indices a worker has yet to run.
+  struct WorkerQueue {
+    std::mutex mutex;
+    size_t begin = 0;
+    size_t end = 0;
+  };
+
+  size_t workerCount;
+  Unique<WorkerQueue[]> queues;
+  Vector<std::thread> threads;
+
+  std::mutex mutex;
+  std::condition_variable loopStarted;
+  std::condition_variable loopFinished;
+  // Body of the loop being run, which is passed the index and the worker
+  // running it.
+  const std::function<void(size_t, size_t)>* body = nullptr;
+  // Diagnostics of the thread that started the loop, which errors the body
+  // reports on other workers go to.
+  Diagnostics* diagnostics = nullptr;
+  // Incremented for every loop, so waiting threads can tell a new one started.
+  uint64_t loopCount = 0;
+  // Workers that haven't run out of indices in the current loop yet.
+  size_t activeWorkers = 0;
+  bool stopping = false;
+
+  ThreadPool(size_t workerCount)
+      : workerCount(std::max<size_t>(workerCount, 1)),
+        queues(new WorkerQueue[this->workerCount]) {
+    for (size_t worker = 1; worker < this->workerCount; worker++) {
+      this->threads.emplace_back([this, worker]() { this->wait(worker); });
+    }
+  }
+
+  ~ThreadPool() {
+    {
+      std::lock_guard<std::mutex> lock(this->mutex);
+      this->stopping = true;
+    }
+    this->loopStarted.notify_all();
+    for (auto& thread : this->threads) {
+      thread.join();
+    }
+  }
+
+  size_t getWorkerCount() const { return this->workerCount; }
+
+  // Runs the body for every index from 0 to count, returning once all of them
+  // are done.
+  void parallelFor(size_t count,
+                   const std::function<void(size_t, size_t)>& body) {
+    if (this->workerCount == 1 || count <= 1) {
+      for (size_t i = 0; i < count; i++) {
+        body(i, 0);
+      }
+      return;
+    }
+
+    for (size_t worker = 0; worker < this->workerCount; worker++) {
+      this->queues[worker].begin = count * worker / this->workerCount;
+      this->queues[worker].end = count * (worker + 1) / this->workerCount;
+    }
+    {
+      std::lock_guard<std::mutex> lock(this->mutex);
+      this->body = &body;
+      this->diagnostics = currentDiagnostics;
+      this->activeWorkers = this->workerCount;
+      this->loopCount++;
+    }
+    this->loopStarted.notify_all();
+
+    this->run(0);
+    std::unique_lock<std::mutex> lock(this->mutex);
+    this->loopFinished.wait(lock, [&]() { return this->activeWorkers == 0; });
+  }
+
+  // Waits for loops to run, until the pool is destroyed.
+  void wait(size_t worker) {
+    uint64_t loopsSeen = 0;
+    while (true) {
+      {
+        std::unique_lock<std::mutex> lock(this->mutex);
+        this->loopStarted.wait(lock, [&]() {
+          return this->stopping || this->loopCount != loopsSeen;
+        });
+        if (this->stopping) {
+          return;
+        }
+        loopsSeen = this->loopCount;
+      }
+      this->run(worker);
+    }
+  }
+
+  // Runs indices of the current loop until there are none left anywhere.
+  void run(size_t worker) {
+    currentDiagnostics = this->diagnostics;
+    size_t index;
+    while (this->takeIndex(worker, index) || this->steal(worker, index)) {
+      (*this->body)(index, worker);
+    }
+    std::lock_guard<std::mutex> lock(this->mutex);
+    this->activeWorkers--;
+    if (this->activeWorkers == 0) {
+      this->loopFinished.notify_all();
+    }
+  }
+
+  bool takeIndex(size_t worker, size_t& index) {
+    WorkerQueue& queue = this->queues[worker];
+    std::lock_guard<std::mutex> lock(queue.mutex);
+    if (queue.begin == queue.end) {
+      return false;
+    }
+    index = queue.begin++;
+    return true;
+  }
+
+  // Takes the upper half of the first other worker's indices that has any
+  // left, returning the first of them to run now.
+  bool steal(size_t worker, size_t& index) {
+    for (size_t i = 1; i < this->workerCount; i++) {
+      WorkerQueue& victim = this->queues[(worker + i) % this->workerCount];
+      size_t begin;
+      size_t end;
+      {
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        if (victim.begin == victim.end) {
+          continue;
+        }
+        begin = victim.begin + (victim.end - victim.begin) / 2;
+        end = victim.end;
+        victim.end = begin;
+      }
+      WorkerQueue& queue = this->queues[worker];
+      std::lock_guard<std::mutex> lock(queue.mutex);
+      queue.begin = begin + 1;
+      queue.end = end;
+      index = begin;
+      return true;
+    }
+    return false;
+  }
+};
+
+#endif  // THREAD_POOL_CC
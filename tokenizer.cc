@@ -2,6 +2,8 @@
 #define TOKENIZER_CC
 
 #include "builtins.cc"
+#include "location.cc"
+#include "scan.cc"
 
 // Token Type enum and their string names for debugging.
 #define FOREACH_TOKEN_TYPE(GENERATOR) \
@@ -28,6 +30,7 @@
   GENERATOR(LESS)                     \
   GENERATOR(LESS_EQUAL)               \
   GENERATOR(FN)                       \
+  GENERATOR(PUB)                      \
   GENERATOR(RETURN)                   \
   GENERATOR(IF)                       \
   GENERATOR(ELIF)                     \
@@ -36,19 +39,154 @@
   GENERATOR(IDENTIFIER)               \
   GENERATOR(INT)                      \
   GENERATOR(FLOAT)                    \
+  GENERATOR(STRING)                   \
   GENERATOR(NUMBER_LITERAL)           \
   GENERATOR(STRING_LITERAL)
-enum class TokenType { FOREACH_TOKEN_TYPE(ENUM_GENERATOR) };
+enum class TokenType : uint8_t { FOREACH_TOKEN_TYPE(ENUM_GENERATOR) };
 static const char* tokenTypeString[] = {FOREACH_TOKEN_TYPE(STRING_GENERATOR)};
 StringView tokenTypeToString(TokenType type) {
   return tokenTypeString[static_cast<int>(type)];
 }
 
-// Output token from tokenizer.
+// Keywords with their token type and text. Keyword token types must also be
+// listed in FOREACH_TOKEN_TYPE.
+#define FOREACH_KEYWORD(GENERATOR) \
+  GENERATOR(FN, fn)                \
+  GENERATOR(PUB, pub)              \
+  GENERATOR(RETURN, return)        \
+  GENERATOR(IF, if)                \
+  GENERATOR(ELIF, elif)            \
+  GENERATOR(ELSE, else)            \
+  GENERATOR(FOR, for)              \
+  GENERATOR(INT, int)              \
+  GENERATOR(FLOAT, float)          \
+  GENERATOR(STRING, string)
+#define KEYWORD_GENERATOR(TYPE, TEXT) Keyword{#TEXT, TokenType::TYPE},
+
+struct Keyword {
+  StringView text;
+  TokenType type;
+};
+static constexpr Keyword keywords[] = {FOREACH_KEYWORD(KEYWORD_GENERATOR)};
+
+// Perfect hash table of keywords, keyed on the length, first and last
+// character of the text. Looking up an identifier is then a single probe
+// followed by a comparison against the one keyword it could be.
+struct KeywordTable {
+  static constexpr size_t SIZE = 64;
+  // Multiplier that spreads the keywords without collisions, found at compile
+  // time.
+  uint32_t multiplier = 0;
+  Keyword slots[SIZE] = {};
+
+  static constexpr size_t hash(uint32_t multiplier, size_t length, char first,
+                               char last) {
+    uint32_t key = (uint32_t)length | ((uint8_t)first << 8) |
+                   ((uint8_t)last << 16);
+    return (key * multiplier) >> 26;
+  }
+
+  static constexpr size_t hash(uint32_t multiplier, StringView text) {
+    return hash(multiplier, text.length(), text.front(), text.back());
+  }
+
+  // Tries odd multipliers until every keyword lands in its own slot.
+  static constexpr KeywordTable make() {
+    for (uint32_t attempt = 0; attempt < 10000; attempt++) {
+      uint32_t multiplier = 0x9E3779B1 + attempt * 0x6A09E668;
+      KeywordTable table;
+      table.multiplier = multiplier;
+      bool collided = false;
+      for (const Keyword& keyword : keywords) {
+        Keyword& slot = table.slots[hash(multiplier, keyword.text)];
+        if (!slot.text.empty()) {
+          collided = true;
+          break;
+        }
+        slot = keyword;
+      }
+      if (!collided) {
+        return table;
+      }
+    }
+    return KeywordTable();
+  }
+
+  TokenType getType(StringView text) const {
+    const Keyword& slot = this->slots[hash(this->multiplier, text)];
+    if (slot.text.length() == text.length() &&
+        memcmp(slot.text.data(), text.data(), text.length()) == 0) {
+      return slot.type;
+    }
+    return TokenType::IDENTIFIER;
+  }
+};
+static constexpr KeywordTable keywordTable = KeywordTable::make();
+static_assert(keywordTable.multiplier != 0,
+              "Could not find a perfect hash for the keywords.");
+
+// Returns the keyword token type of the identifier text, or IDENTIFIER if it
+// isn't a keyword. The text must not be empty.
+TokenType getKeywordType(StringView text) {
+  return keywordTable.getType(text);
+}
+
+// Largest source we can tokenize, since tokens store 32-bit offsets. Larger
+// sources are rejected with an error rather than tokenized incorrectly.
+const size_t MAX_SOURCE_SIZE = UINT32_MAX;
+
+// Token lengths at or above this are stored as this escape value, and their
+// end is found again by rescanning the token when it's needed.
+const uint16_t LONG_TOKEN_LENGTH = UINT16_MAX;
+
+// Finds the end of a token that was too long to store its length, which can
+// only be a string literal, number literal or identifier.
+size_t findLongTokenEnd(StringView code, TokenType type, size_t start) {
+  if (type == TokenType::STRING_LITERAL) {
+    // Include both of the quotes.
+    return scan<StringBodyClass>(code, start + 1) + 1;
+  }
+  if (type == TokenType::NUMBER_LITERAL) {
+    size_t end = scan<DigitClass>(code, start);
+    if (end < code.length() && code[end] == '.') {
+      end = scan<DigitClass>(code, end + 1);
+    }
+    return end;
+  }
+  return scan<IdentifierClass>(code, start);
+}
+
+// Output token from tokenizer, packed into 8 bytes so that tokens are cheap to
+// copy around and to buffer for a whole file.
 struct Token {
+  uint32_t start;
+  // Length of the token, or LONG_TOKEN_LENGTH if it doesn't fit.
+  uint16_t length;
   TokenType type;
-  size_t start;
-  size_t end;
+
+  static Token make(TokenType type, size_t start, size_t end) {
+    size_t length = end - start;
+    return Token{.start = static_cast<uint32_t>(start),
+                 .length = length < LONG_TOKEN_LENGTH
+                               ? static_cast<uint16_t>(length)
+                               : LONG_TOKEN_LENGTH,
+                 .type = type};
+  }
+
+  size_t getStart() const { return this->start; }
+
+  // Index right after the token. The code is needed to find the end of long
+  // tokens.
+  size_t getEnd(StringView code) const {
+    if (this->length == LONG_TOKEN_LENGTH) [[unlikely]] {
+      return findLongTokenEnd(code, this->type, this->start);
+    }
+    return this->start + this->length;
+  }
+
+  StringView getValue(StringView code) const {
+    return code.substr(this->start, this->getEnd(code) - this->start);
+  }
 
   String toString(StringView source) {
     bool showText = false;
@@ -61,19 +199,78 @@ struct Token {
     StringStream output;
     output << tokenTypeToString(this->type);
     if (showText) {
-      output << " ";
-      for (size_t i = this->start; i < this->end; i++) {
-        output << source[i];
-      }
+      output << " " << this->getValue(source);
     }
     return output.str();
   }
 };
+static_assert(sizeof(Token) == 8, "Token should stay packed into 8 bytes.");
+
+// Tokens for a whole file, stored as struct-of-arrays so that walking token
+// types stays within a few cache lines.
+struct TokenBuffer {
+  // Nuo code that the tokens point into.
+  StringView code;
+  Vector<uint8_t> types;
+  Vector<uint32_t> starts;
+  Vector<uint16_t> lengths;
+
+  TokenBuffer() {}
+
+  TokenBuffer(StringView code) : code(code) {}
+
+  size_t size() const { return this->types.size(); }
+
+  void reserve(size_t capacity) {
+    this->types.reserve(capacity);
+    this->starts.reserve(capacity);
+    this->lengths.reserve(capacity);
+  }
+
+  void push(Token token) {
+    this->types.push_back(static_cast<uint8_t>(token.type));
+    this->starts.push_back(token.start);
+    this->lengths.push_back(token.length);
+  }
+
+  TokenType getType(size_t index) const {
+    return static_cast<TokenType>(this->types[index]);
+  }
 
-// Used when printing error messages.
-struct Location {
-  int line;
-  int col;
+  size_t getStart(size_t index) const { return this->starts[index]; }
+
+  size_t getEnd(size_t index) const {
+    return this->get(index).getEnd(this->code);
+  }
+
+  // Appends the first count tokens of the other buffer, whose starts are
+  // relative to the given offset in this buffer's code.
+  void append(const TokenBuffer& other, size_t count, size_t offset) {
+    this->types.insert(this->types.end(), other.types.begin(),
+                       other.types.begin() + count);
+    this->lengths.insert(this->lengths.end(), other.lengths.begin(),
+                         other.lengths.begin() + count);
+    size_t startsSize = this->starts.size();
+    this->starts.resize(startsSize + count);
+    for (size_t i = 0; i < count; i++) {
+      this->starts[startsSize + i] = other.starts[i] + offset;
+    }
+  }
+
+  bool equals(const TokenBuffer& other) const {
+    return this->types == other.types && this->starts == other.starts &&
+           this->lengths == other.lengths;
+  }
+
+  Token get(size_t index) const {
+    return Token{.start = this->starts[index],
+                 .length = this->lengths[index],
+                 .type = this->getType(index)};
+  }
+
+  StringView getValue(size_t index) const {
+    return this->get(index).getValue(this->code);
+  }
 };
 
 struct Tokenizer {
@@ -85,10 +282,57 @@ struct Tokenizer {
   size_t end = 0;
   // Number of open parenthesis we see so far.
   size_t openParenCount = 0;
+  // Start of every line, built on the first location lookup.
+  LineIndex lineIndex;
+  // Error of the token that failed to tokenize.
+  Optional<ErrorId> error;
 
   Tokenizer(StringView code) : code(code) {}
 
+  // Tokenizes the next token on demand.
   Result<Token> next() {
+    if (this->code.length() > MAX_SOURCE_SIZE) [[unlikely]] {
+      return this->getSourceSizeError();
+    }
+    Token token = this->scanToken();
+    if (this->error.has_value()) [[unlikely]] {
+      return Error(this->error.value());
+    }
+    return Ok(token);
+  }
+
+  // Tokenizes all of the remaining code in one tight loop. Tokens are produced
+  // without wrapping each one in a Result, and are stored in a compact buffer
+  // that the parser can walk and look ahead in by index.
+  Result<TokenBuffer> tokenize() {
+    if (this->code.length() > MAX_SOURCE_SIZE) {
+      return this->getSourceSizeError();
+    }
+    TokenBuffer tokens(this->code);
+    // Our code averages a token every few characters, so reserving for one
+    // every four avoids most regrowth without holding on to much extra memory.
+    tokens.reserve(this->code.length() / 4 + 1);
+    while (true) {
+      Token token = this->scanToken();
+      if (this->error.has_value()) [[unlikely]] {
+        return Error(this->error.value());
+      }
+      tokens.push(token);
+      if (token.type == TokenType::END) {
+        break;
+      }
+    }
+    return Ok(std::move(tokens));
+  }
+
+  DeduceReturnForErrorResult getSourceSizeError() {
+    return Error("Source is {} bytes, which is over the limit of {} bytes.",
+                 this->code.length(), MAX_SOURCE_SIZE);
+  }
+
+  // Scans the next token. On failure, the error is set and an END token is
+  // returned.
+  Token scanToken() {
     this->skipWhitespace();
 
     // Move start of token to end of whitespace.
@@ -96,96 +340,87 @@ struct Tokenizer {
 
     // Return early if we reached the end of the file.
     if (this->isAtEnd()) {
-      return Ok(this->makeToken(TokenType::END));
+      return this->makeToken(TokenType::END);
     }
 
     char c = this->getChar();
     if (c == '\n') {
-      return Ok(this->makeToken(TokenType::NEWLINE));
+      return this->makeToken(TokenType::NEWLINE);
     } else if (this->isAlpha(c)) {
-      // Place end back to beginning of token, since makeIdentifierToken needs
-      // to see all characters to decide if it is a keyword.
-      this->end--;
-      return Ok(this->makeIdentifierToken());
+      return this->makeIdentifierToken();
     } else if (this->isDigit(c)) {
       return this->makeNumberToken();
     } else if (c == '"') {
       return this->makeStringToken();
     } else if (c == '(') {
       this->openParenCount++;
-      return Ok(this->makeToken(TokenType::LEFT_PAREN));
+      return this->makeToken(TokenType::LEFT_PAREN);
     } else if (c == ')') {
       this->openParenCount--;
-      return Ok(this->makeToken(TokenType::RIGHT_PAREN));
+      return this->makeToken(TokenType::RIGHT_PAREN);
     } else if (c == '{') {
-      return Ok(this->makeToken(TokenType::LEFT_BRACE));
+      return this->makeToken(TokenType::LEFT_BRACE);
     } else if (c == '}') {
-      return Ok(this->makeToken(TokenType::RIGHT_BRACE));
+      return this->makeToken(TokenType::RIGHT_BRACE);
     } else if (c == '[') {
-      return Ok(this->makeToken(TokenType::LEFT_BRACKET));
+      return this->makeToken(TokenType::LEFT_BRACKET);
     } else if (c == ']') {
-      return Ok(this->makeToken(TokenType::RIGHT_BRACKET));
+      return this->makeToken(TokenType::RIGHT_BRACKET);
     } else if (c == ',') {
-      return Ok(this->makeToken(TokenType::COMMA));
+      return this->makeToken(TokenType::COMMA);
     } else if (c == ':') {
-      return Ok(this->makeToken(TokenType::COLON));
+      return this->makeToken(TokenType::COLON);
     } else if (c == '=') {
       if (this->peekChar() == '=') {
         this->consumeChar();
-        return Ok(this->makeToken(TokenType::EQUAL_EQUAL));
+        return this->makeToken(TokenType::EQUAL_EQUAL);
       }
-      return Ok(this->makeToken(TokenType::EQUAL));
+      return this->makeToken(TokenType::EQUAL);
     } else if (c == '!') {
       if (this->peekChar() == '=') {
         this->consumeChar();
-        return Ok(this->makeToken(TokenType::BANG_EQUAL));
+        return this->makeToken(TokenType::BANG_EQUAL);
       }
-      return Ok(this->makeToken(TokenType::BANG));
+      return this->makeToken(TokenType::BANG);
     } else if (c == '<') {
       if (this->peekChar() == '=') {
         this->consumeChar();
-        return Ok(this->makeToken(TokenType::LESS_EQUAL));
+        return this->makeToken(TokenType::LESS_EQUAL);
       }
-      return Ok(this->makeToken(TokenType::LESS));
+      return this->makeToken(TokenType::LESS);
     } else if (c == '>') {
       if (this->peekChar() == '=') {
         this->consumeChar();
-        return Ok(this->makeToken(TokenType::GREATER_EQUAL));
+        return this->makeToken(TokenType::GREATER_EQUAL);
       }
-      return Ok(this->makeToken(TokenType::GREATER));
+      return this->makeToken(TokenType::GREATER);
     } else if (c == '+') {
       if (this->peekChar() == '=') {
         this->consumeChar();
-        return Ok(this->makeToken(TokenType::PLUS_EQUAL));
+        return this->makeToken(TokenType::PLUS_EQUAL);
       }
-      return Ok(this->makeToken(TokenType::PLUS));
+      return this->makeToken(TokenType::PLUS);
     } else if (c == '-') {
       if (this->peekChar() == '=') {
         this->consumeChar();
-        return Ok(this->makeToken(TokenType::MINUS_EQUAL));
+        return this->makeToken(TokenType::MINUS_EQUAL);
       }
-      return Ok(this->makeToken(TokenType::MINUS));
+      return this->makeToken(TokenType::MINUS);
     }
 
     Location loc = this->getLocation();
-    return Error("Ran into an unexpected character '{}' at line {} column {}",
-                 c, loc.line, loc.col);
+    return this->fail("Ran into an unexpected character '{}' at {}.", c, loc);
   }
 
   // Get the location of the given start position in the code. It's easier to do
-  // this rather than keeping track of line and column as we tokenize,
-  // especially if the only time we need location info is when outputting an
-  // error message.
-  Location getLocation(int start) {
-    int lineNumber = 1;
-    int lineStartIndex = 0;
-    for (int i = 0; i <= start; i++) {
-      if (this->code[i] == '\n') {
-        lineNumber += 1;
-        lineStartIndex = i + 1;
-      }
+  // this rather than keeping track of line and column as we tokenize. The line
+  // index is only built once the first location is needed, which is usually
+  // when outputting an error message or building the AST.
+  Location getLocation(size_t start) {
+    if (!this->lineIndex.isBuilt()) {
+      this->lineIndex.build(this->code);
     }
-    return {.line = lineNumber, .col = start - lineStartIndex + 1};
+    return this->lineIndex.getLocation(start);
   }
 
   // Get the location of the token currently being processed.
@@ -222,175 +457,66 @@ struct Tokenizer {
 
   bool isDigit(char c) { return c >= '0' && c <= '9'; }
 
+  // Consume all whitespace characters, including newlines if we are within a
+  // parenthesis.
   void skipWhitespace() {
-    while (!this->isAtEnd()) {
-      char c = this->peekChar();
-      // Consume all whitespace characters.
-      if (c == ' ' || c == '\t' || c == '\r') {
-        this->consumeChar();
-      }
-      // Consume any newline characters if we are within a parenthesis.
-      else if (c == '\n' && this->openParenCount > 0) {
-        this->consumeChar();
-      } else {
-        break;
-      }
+    if (this->openParenCount > 0) {
+      this->end = scan<SpaceOrNewlineClass>(this->code, this->end);
+    } else {
+      this->end = scan<SpaceClass>(this->code, this->end);
     }
   }
 
   Token makeToken(TokenType type) {
-    return Token{.type = type, .start = this->start, .end = this->end};
+    return Token::make(type, this->start, this->end);
   }
 
-  bool isIdentifierChar() {
-    return this->isAlpha(this->peekChar()) || this->isDigit(this->peekChar());
+  // Records the error for the current token and stops tokenizing.
+  template <typename... Args>
+  Token fail(std::format_string<Args...> fmt, Args&&... args) {
+    this->error = getDiagnostics().add(fmt, std::forward<Args>(args)...);
+    return this->makeToken(TokenType::END);
   }
 
   Token makeIdentifierToken() {
-    if (this->matchChar('e')) {
-      // token: e
-      if (this->matchChar('l')) {
-        // token: el
-        if (this->matchChar('i')) {
-          // token: eli
-          if (this->matchChar('f')) {
-            // token: elif
-            if (!this->isIdentifierChar()) {
-              // token: elif<end>
-              return this->makeToken(TokenType::ELIF);
-            }
-          }
-        } else if (this->matchChar('s')) {
-          // token: els
-          if (this->matchChar('e')) {
-            // token: else
-            if (!this->isIdentifierChar()) {
-              // token: else<end>
-              return this->makeToken(TokenType::ELSE);
-            }
-          }
-        }
-      }
-    } else if (this->matchChar('f')) {
-      // token: f
-      if (this->matchChar('l')) {
-        // token: fl
-        if (this->matchChar('o')) {
-          // token: flo
-          if (this->matchChar('a')) {
-            // token: floa
-            if (this->matchChar('t')) {
-              // token: float
-              if (!this->isIdentifierChar()) {
-                // token: float<end>
-                return this->makeToken(TokenType::FLOAT);
-              }
-            }
-          }
-        }
-      } else if (this->matchChar('n')) {
-        // token: fn
-        if (!this->isIdentifierChar()) {
-          // token: fn<end>
-          return this->makeToken(TokenType::FN);
-        }
-      } else if (this->matchChar('o')) {
-        // token: fo
-        if (this->matchChar('r')) {
-          // token: for
-          if (!this->isIdentifierChar()) {
-            // token: for<end>
-            return this->makeToken(TokenType::FOR);
-          }
-        }
-      }
-    } else if (this->matchChar('i')) {
-      // token: i
-      if (this->matchChar('f')) {
-        // token: if
-        if (!this->isIdentifierChar()) {
-          // token: if<end>
-          return this->makeToken(TokenType::IF);
-        }
-      } else if (this->matchChar('n')) {
-        // token: in
-        if (this->matchChar('t')) {
-          // token: int
-          if (!this->isIdentifierChar()) {
-            // token: int<end>
-            return this->makeToken(TokenType::INT);
-          }
-        }
-      }
-    } else if (this->matchChar('r')) {
-      // token: r
-      if (this->matchChar('e')) {
-        // token: re
-        if (this->matchChar('t')) {
-          // token: ret
-          if (this->matchChar('u')) {
-            // token: retu
-            if (this->matchChar('r')) {
-              // token: retur
-              if (this->matchChar('n')) {
-                // token: return
-                if (!this->isIdentifierChar()) {
-                  // token: return<end>
-                  return this->makeToken(TokenType::RETURN);
-                }
-              }
-            }
-          }
-        }
-      }
-    }
-    // Since we didn't match any keywords, we have a user-defined identifier.
-    // Consume all remaining alphabet or digit tokens.
-    while (!this->isAtEnd() && this->isIdentifierChar()) {
-      this->consumeChar();
-    }
-    return this->makeToken(TokenType::IDENTIFIER);
+    // Consume the rest of the identifier, then check if it is a keyword.
+    this->end = scan<IdentifierClass>(this->code, this->end);
+    StringView text = this->code.substr(this->start, this->end - this->start);
+    return this->makeToken(getKeywordType(text));
   }
 
-  Result<Token> makeNumberToken() {
+  Token makeNumberToken() {
     // Consume the first part of the number.
     this->consumeNumberChars();
     // Consume the second part of the number after decimal place.
     if (this->peekChar() == '.') {
       this->consumeChar();
       if (!this->isDigit(this->peekChar())) {
-        Location loc = this->getLocation();
-        return Error(
-            "Unexpected character '{}' after number decimal at line {} column "
-            "{}",
-            this->peekChar(), loc.line, this->end + 1);
+        Location loc = this->getLocation(this->end);
+        return this->fail(
+            "Unexpected character '{}' after number decimal at {}.",
+            this->peekChar(), loc);
       }
       consumeNumberChars();
     }
-    return Ok(this->makeToken(TokenType::NUMBER_LITERAL));
+    return this->makeToken(TokenType::NUMBER_LITERAL);
   }
 
   void consumeNumberChars() {
-    while (!this->isAtEnd() && this->isDigit(this->peekChar())) {
-      this->consumeChar();
-    }
+    this->end = scan<DigitClass>(this->code, this->end);
   }
 
-  Result<Token> makeStringToken() {
+  Token makeStringToken() {
     // Consume characters until we reach the end of the string or the end of the
     // file.
-    while (!this->isAtEnd() && this->peekChar() != '"') {
-      this->consumeChar();
-    }
+    this->end = scan<StringBodyClass>(this->code, this->end);
     // Return string token only if we've truly reached the end of the string.
     if (!this->isAtEnd() && this->peekChar() == '"') {
       this->consumeChar();
-      Token stringToken = this->makeToken(TokenType::STRING_LITERAL);
-      return Ok(stringToken);
+      return this->makeToken(TokenType::STRING_LITERAL);
     }
     Location loc = this->getLocation();
-    return Error("Unterminated string that started at line {} column {}.",
-                 loc.line, loc.col);
+    return this->fail("Unterminated string that started at {}.", loc);
   }
 };
 
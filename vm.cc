@@ -0,0 +1,179 @@
+#ifndef VM_CC
+#define VM_CC
+
+#include "builtins.cc"
+#include "bytecode.cc"
+#include "output_buffer.cc"
+
+// Most calls that can be nested, which only recursion reaches. Until the
+// language has control flow, recursion never ends, so this is reported as
+// an error instead of running out of memory.
+const size_t MAX_CALL_DEPTH = 100000;
+
+// Interpreter for bytecode. The registers of every active call live in one
+// stack, each call's right after its caller's, so a call only copies its
+// arguments. Instructions are dispatched with computed gotos, where each
+// handler jumps straight to the next one's. That gives every handler its own
+// indirect branch, which the CPU predicts better than the single one of a
+// switch in a loop. Labels as values are a GNU extension, which both Clang and
+// GCC support.
+struct Vm {
+  // State of a caller, restored when the call returns.
+  struct Frame {
+    const BytecodeFunction* function;
+    const BytecodeInstruction* returnAddress;
+    size_t registerStart;
+    // Register the result of the call goes to.
+    uint16_t resultRegister;
+  };
+
+  const BytecodeProgram* program;
+  // Where println writes.
+  OutputBuffer* out;
+  // Whether println writes its line out right away rather than leaving it in
+  // the buffer, for output someone may be waiting on.
+  bool flushEachLine = false;
+  Vector<Value> stack;
+  Vector<Frame> frames;
+
+  // Runs main and returns its result, which is 0 unless main returns an INT.
+  Result<int64_t> run(const BytecodeProgram& program, OutputBuffer& out) {
+    this->program = &program;
+    this->out = &out;
+    this->frames.clear();
+
+#define BYTECODE_LABEL_GENERATOR(OPCODE) &&DO_##OPCODE,
+    static void* const labels[] = {
+        FOREACH_BYTECODE_OPCODE(BYTECODE_LABEL_GENERATOR)};
+#undef BYTECODE_LABEL_GENERATOR
+#define DISPATCH()                                       \
+  do {                                                   \
+    instruction = pc++;                                  \
+    goto* labels[static_cast<int>(instruction->opcode)]; \
+  } while (false)
+#define BINARY(OPCODE, FIELD, EXPRESSION)         \
+  DO_##OPCODE : {                                 \
+    auto left = registers[instruction->b].FIELD;  \
+    auto right = registers[instruction->c].FIELD; \
+    registers[instruction->a].FIELD = EXPRESSION; \
+    DISPATCH();                                   \
+  }
+#define COMPARISON(OPCODE, FIELD, OPERATOR)                   \
+  DO_##OPCODE : {                                             \
+    auto left = registers[instruction->b].FIELD;              \
+    auto right = registers[instruction->c].FIELD;             \
+    registers[instruction->a].intValue = left OPERATOR right; \
+    DISPATCH();                                               \
+  }
+
+    const BytecodeFunction* function =
+        &program.functions[program.mainFunction];
+    size_t registerStart = 0;
+    this->reserveRegisters(function->registerCount);
+    Value* registers = this->stack.data();
+    const BytecodeInstruction* pc = function->instructions.data();
+    const BytecodeInstruction* instruction;
+    DISPATCH();
+
+    DO_LOAD_CONSTANT:
+      registers[instruction->a] =
+          function->constants[instruction->getImmediate()];
+      DISPATCH();
+    DO_LOAD_STRING:
+      registers[instruction->a].stringValue =
+          &program.strings[instruction->getImmediate()];
+      DISPATCH();
+
+    COMPARISON(EQUAL_INT, intValue, ==)
+    COMPARISON(NOT_EQUAL_INT, intValue, !=)
+    COMPARISON(LESS_INT, intValue, <)
+    COMPARISON(LESS_EQUAL_INT, intValue, <=)
+    COMPARISON(GREATER_INT, intValue, >)
+    COMPARISON(GREATER_EQUAL_INT, intValue, >=)
+    // Ints have 32 bits like C's int, but overflow wraps around instead of
+    // being undefined.
+    BINARY(ADD_INT, intValue, (int32_t)((uint32_t)left + (uint32_t)right))
+    BINARY(SUBTRACT_INT, intValue,
+           (int32_t)((uint32_t)left - (uint32_t)right))
+    COMPARISON(EQUAL_FLOAT, floatValue, ==)
+    COMPARISON(NOT_EQUAL_FLOAT, floatValue, !=)
+    COMPARISON(LESS_FLOAT, floatValue, <)
+    COMPARISON(LESS_EQUAL_FLOAT, floatValue, <=)
+    COMPARISON(GREATER_FLOAT, floatValue, >)
+    COMPARISON(GREATER_EQUAL_FLOAT, floatValue, >=)
+    BINARY(ADD_FLOAT, floatValue, left + right)
+    BINARY(SUBTRACT_FLOAT, floatValue, left - right)
+
+    DO_CALL: {
+      const BytecodeCall& call = function->calls[instruction->getImmediate()];
+      const BytecodeFunction* callee = &program.functions[call.function];
+      if (this->frames.size() == MAX_CALL_DEPTH) {
+        return Error("Calls to {} are nested more than {} deep.",
+                     symbolTable.getName(callee->name), MAX_CALL_DEPTH);
+      }
+      size_t calleeStart = registerStart + function->registerCount;
+      if (calleeStart + callee->registerCount > this->stack.size()) {
+        this->reserveRegisters(calleeStart + callee->registerCount);
+        registers = this->stack.data() + registerStart;
+      }
+      Value* calleeRegisters = registers + function->registerCount;
+      const uint16_t* arguments =
+          function->arguments.data() + call.argumentStart;
+      for (uint32_t i = 0; i < callee->paramCount; i++) {
+        calleeRegisters[i] = registers[arguments[i]];
+      }
+      this->frames.push_back(Frame{.function = function,
+                                   .returnAddress = pc,
+                                   .registerStart = registerStart,
+                                   .resultRegister = instruction->a});
+      function = callee;
+      registerStart = calleeStart;
+      registers = calleeRegisters;
+      pc = callee->instructions.data();
+      DISPATCH();
+    }
+
+    DO_PRINTLN:
+      out.write(*registers[instruction->a].stringValue);
+      out.writeChar('\n');
+      if (this->flushEachLine) {
+        out.flush();
+      }
+      DISPATCH();
+
+    DO_RETURN:
+    DO_RETURN_VOID: {
+      bool hasResult = instruction->opcode == BytecodeOpcode::RETURN;
+      Value result = hasResult ? registers[instruction->a] : Value{};
+      if (this->frames.empty()) {
+        return Ok(hasResult && function->returnType == BaseType::INT
+                      ? result.intValue
+                      : 0);
+      }
+      const Frame& frame = this->frames.back();
+      function = frame.function;
+      pc = frame.returnAddress;
+      registerStart = frame.registerStart;
+      registers = this->stack.data() + registerStart;
+      if (hasResult) {
+        registers[frame.resultRegister] = result;
+      }
+      this->frames.pop_back();
+      DISPATCH();
+    }
+
+#undef COMPARISON
+#undef BINARY
+#undef DISPATCH
+  }
+
+  // Grows the stack to hold at least the given number of registers, at least
+  // doubling it so growing takes amortized constant time.
+  void reserveRegisters(size_t count) {
+    if (count > this->stack.size()) {
+      this->stack.resize(std::max(count, this->stack.size() * 2));
+    }
+  }
+};
+
+#endif  // VM_CC